@@ -0,0 +1,401 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCH_SSE2
+#include <emmintrin.h>
+#endif
+
+// bits of the level column, for whether the level is in the IFR series, and
+// whether it has the right parity for either direction
+const uint8_t LEVEL_SERIES = 1, LEVEL_ODD = 2, LEVEL_EVEN = 4;
+
+// exit points are packed into a bit set per plan, if a SID's constraints refer
+// to few enough of them
+const size_t POINT_BITS = 64;
+
+static uint32_t pack(std::string_view s) {
+	uint32_t packed = 0;
+	memcpy(&packed, s.data(), std::min(s.size(), sizeof packed));
+	return packed;
+}
+
+static uint32_t pack_mask(size_t length) {
+	uint32_t mask = 0;
+	memset(&mask, 0xff, std::min(length, sizeof mask));
+	return mask;
+}
+
+#ifdef BATCH_SSE2
+// four vectors of 32-bit masks to one of 8-bit masks
+static inline __m128i narrow(__m128i a, __m128i b, __m128i c, __m128i d) {
+	return _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+}
+
+// 32-bit masks of which of four bit sets share no bits with the mask
+static inline __m128i disjoint(const uint64_t *sets, __m128i mask) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i a = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *) sets), mask), zero);
+	__m128i b = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i *) (sets + 2)), mask), zero);
+
+	// a set is disjoint if both its halves are
+	a = _mm_and_si128(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+	b = _mm_and_si128(b, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	return _mm_unpacklo_epi64(
+		_mm_shuffle_epi32(a, _MM_SHUFFLE(2, 0, 2, 0)),
+		_mm_shuffle_epi32(b, _MM_SHUFFLE(2, 0, 2, 0))
+	);
+}
+#endif
+
+// out[i] |= (column[i] & mask) == value
+static void match_prefix(const uint32_t *column, size_t n, uint32_t value, uint32_t mask, uint8_t *out) {
+	size_t i = 0;
+
+#ifdef BATCH_SSE2
+	__m128i vvalue = _mm_set1_epi32((int) value), vmask = _mm_set1_epi32((int) mask), one = _mm_set1_epi8(1);
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i eq[4];
+		for (int j = 0; j < 4; j++) {
+			__m128i x = _mm_loadu_si128((const __m128i *) (column + i + j * 4));
+			eq[j] = _mm_cmpeq_epi32(_mm_and_si128(x, vmask), vvalue);
+		}
+
+		__m128i acc = _mm_loadu_si128((const __m128i *) (out + i));
+		acc = _mm_or_si128(acc, _mm_and_si128(narrow(eq[0], eq[1], eq[2], eq[3]), one));
+		_mm_storeu_si128((__m128i *) (out + i), acc);
+	}
+#endif
+
+	for (; i < n; i++) out[i] |= (column[i] & mask) == value;
+}
+
+// out[i] |= column[i] == value
+static void match_byte(const uint8_t *column, size_t n, uint8_t value, uint8_t *out) {
+	size_t i = 0;
+
+#ifdef BATCH_SSE2
+	__m128i vvalue = _mm_set1_epi8((char) value), one = _mm_set1_epi8(1);
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (column + i)), vvalue);
+		__m128i acc = _mm_loadu_si128((const __m128i *) (out + i));
+		_mm_storeu_si128((__m128i *) (out + i), _mm_or_si128(acc, _mm_and_si128(eq, one)));
+	}
+#endif
+
+	for (; i < n; i++) out[i] |= column[i] == value;
+}
+
+// out[i] = min <= column[i] <= max
+static void match_range(const int32_t *column, size_t n, int32_t min, int32_t max, uint8_t *out) {
+	size_t i = 0;
+
+#ifdef BATCH_SSE2
+	__m128i vmin = _mm_set1_epi32(min), vmax = _mm_set1_epi32(max), one = _mm_set1_epi8(1);
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i out_of_range[4];
+		for (int j = 0; j < 4; j++) {
+			__m128i x = _mm_loadu_si128((const __m128i *) (column + i + j * 4));
+			out_of_range[j] = _mm_or_si128(_mm_cmpgt_epi32(vmin, x), _mm_cmpgt_epi32(x, vmax));
+		}
+
+		__m128i mask = narrow(out_of_range[0], out_of_range[1], out_of_range[2], out_of_range[3]);
+		_mm_storeu_si128((__m128i *) (out + i), _mm_andnot_si128(mask, one));
+	}
+#endif
+
+	for (; i < n; i++) out[i] = !(min > column[i]) && !(column[i] > max);
+}
+
+// out[i] = (column[i] & black) == 0 && (white == 0 || (column[i] & white) != 0)
+static void match_points(const uint64_t *column, size_t n, uint64_t white, uint64_t black, uint8_t *out) {
+	size_t i = 0;
+
+#ifdef BATCH_SSE2
+	__m128i vwhite = _mm_set1_epi64x((long long) white), vblack = _mm_set1_epi64x((long long) black);
+	__m128i all = _mm_set1_epi32(-1), one = _mm_set1_epi8(1);
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i ok[4];
+		for (int j = 0; j < 4; j++) {
+			const uint64_t *sets = column + i + j * 4;
+			__m128i in_white = white ? _mm_xor_si128(disjoint(sets, vwhite), all) : all;
+			ok[j] = _mm_and_si128(disjoint(sets, vblack), in_white);
+		}
+
+		_mm_storeu_si128((__m128i *) (out + i), _mm_and_si128(narrow(ok[0], ok[1], ok[2], ok[3]), one));
+	}
+#endif
+
+	for (; i < n; i++)
+		out[i] = !(column[i] & black) && (!white || (column[i] & white));
+}
+
+// the index of the first restriction which applies to each plan, or -1
+static void match_restrictions(
+	const std::vector<api::Restriction> &restrictions,
+	const api::DateTime &datetime,
+	Span<const BatchPlan> plans,
+	const uint8_t *engine_types,
+	const uint8_t *aircraft_types,
+	int32_t *first,
+	uint8_t *type_ok
+) {
+	size_t n = plans.size();
+	std::fill(first, first + n, -1);
+
+	for (size_t r = 0; r < restrictions.size(); r++) {
+		const api::Restriction &restriction = restrictions[r];
+		if (!restriction_in_time(restriction, datetime)) continue;
+
+		std::fill(type_ok, type_ok + n, restriction.types.empty());
+		for (const std::string &type : restriction.types) {
+			if (type.length() != 1) continue;
+
+			match_byte(engine_types, n, (uint8_t) type[0], type_ok);
+			match_byte(aircraft_types, n, (uint8_t) type[0], type_ok);
+		}
+
+		for (size_t i = 0; i < n; i++)
+			if (first[i] < 0 && type_ok[i] && restriction_has_suffix(restriction, plans[i].sid_suffix))
+				first[i] = (int32_t) r;
+	}
+}
+
+// as Check::check_restrictions, given the first restriction which applies
+static Result restriction_result(
+	const std::vector<api::Restriction> &restrictions,
+	int32_t first,
+	Result &sr_result
+) {
+	if (restrictions.empty()) return Result::Success;
+	if (first < 0) return Result::CondFail;
+
+	const api::Restriction &restriction = restrictions[first];
+	if (restriction.banned) return Result::CondBan;
+	if (restriction.sidlevel && sr_result != Result::Success) sr_result = Result::Success;
+
+	return Result::Success;
+}
+
+// as Check::check_alerts, which depends only on the constraint
+static Result alert_result(const api::Constraint &constraint) {
+	Result result = Result::Success;
+
+	for (const api::Alert &alert : constraint.alerts) {
+		if (alert.ban) return Result::CstrBan;
+		if (alert.warn) result = Result::Warning;
+	}
+
+	return result;
+}
+
+// as Check::check_route
+static bool route_ok(
+	const api::Constraint &constraint,
+	Span<const std::string_view> route,
+	const char *sid_point,
+	std::pmr::memory_resource *scratch
+) {
+	// candidate routes are split in a buffer on the stack
+	char buffer[1024];
+	std::pmr::monotonic_buffer_resource arena(buffer, sizeof buffer, scratch);
+
+	auto predicate = [&](const std::string &candidate) {
+		return route_matches(candidate, route, sid_point, &arena);
+	};
+
+	if (std::any_of(constraint.noroute.begin(), constraint.noroute.end(), predicate)) return false;
+
+	return constraint.route.empty()
+		|| std::any_of(constraint.route.begin(), constraint.route.end(), predicate);
+}
+
+// as Check::check_destination
+static bool destination_ok(const api::Constraint &constraint, std::string_view dest) {
+	auto predicate = [dest](const std::string &slug) {
+		return dest.substr(0, slug.length()) == slug;
+	};
+
+	if (std::any_of(constraint.nodests.begin(), constraint.nodests.end(), predicate)) return false;
+
+	return constraint.dests.empty()
+		|| std::any_of(constraint.dests.begin(), constraint.dests.end(), predicate);
+}
+
+// as Check::check_exit_point
+static bool exit_point_ok(const api::Constraint &constraint, Span<const std::string_view> points) {
+	auto predicate = [points](const std::string &exit_point) {
+		return std::find(points.begin(), points.end(), exit_point) != points.end();
+	};
+
+	if (std::any_of(constraint.nopoints.begin(), constraint.nopoints.end(), predicate)) return false;
+
+	return constraint.points.empty()
+		|| std::any_of(constraint.points.begin(), constraint.points.end(), predicate);
+}
+
+void check_constraints_batch(
+	const api::Sid &sid,
+	const char *sid_point,
+	const api::DateTime &datetime,
+	Span<const BatchPlan> plans,
+	Result *results,
+	std::pmr::memory_resource *scratch
+) {
+	size_t n = plans.size();
+
+	// the exit points which the constraints refer to
+	std::pmr::unordered_map<std::string_view, unsigned> point_ids(scratch);
+	for (const auto &constraint : sid.constraints) {
+		for (const std::string &point : constraint->points) point_ids.emplace(point, (unsigned) point_ids.size());
+		for (const std::string &point : constraint->nopoints) point_ids.emplace(point, (unsigned) point_ids.size());
+	}
+
+	bool points_packed = point_ids.size() <= POINT_BITS;
+
+	// the columns, and the plans whose destinations are too long to be packed
+	std::pmr::vector<uint32_t> destinations(n, scratch);
+	std::pmr::vector<int32_t> levels(n, scratch);
+	std::pmr::vector<uint8_t> level_bits(n, scratch), engine_types(n, scratch), aircraft_types(n, scratch);
+	std::pmr::vector<uint64_t> point_sets(points_packed ? n : 0, scratch);
+	std::pmr::vector<size_t> long_destinations(scratch);
+
+	for (size_t i = 0; i < n; i++) {
+		const BatchPlan &plan = plans[i];
+
+		destinations[i] = pack(plan.destination);
+		if (plan.destination.size() > sizeof(uint32_t)) long_destinations.push_back(i);
+
+		int rfl = plan.cruise_level, fl = rfl / 1000;
+		levels[i] = rfl / 100;
+		level_bits[i] = (rfl % 1000 ? 0 : LEVEL_SERIES)
+			| ((fl <= RVSM_START ? fl % 2 == 1 : (2 + fl - RVSM_START) % 4 == 2) ? LEVEL_ODD : 0)
+			| ((fl <= RVSM_START ? fl % 2 == 0 : (2 + fl - RVSM_START) % 4 == 0) ? LEVEL_EVEN : 0);
+
+		engine_types[i] = (uint8_t) plan.engine_type;
+		aircraft_types[i] = (uint8_t) plan.aircraft_type;
+
+		if (points_packed) {
+			for (std::string_view point : plan.points) {
+				auto id = point_ids.find(point);
+				if (id != point_ids.end()) point_sets[i] |= (uint64_t) 1 << id->second;
+			}
+		}
+	}
+
+	// the outcomes of each stage of a constraint, for each plan
+	std::pmr::vector<uint8_t> dest_ok(n, scratch), dest_banned(n, scratch), exit_ok(n, scratch), level_ok(n, scratch), type_ok(n, scratch);
+	std::pmr::vector<int32_t> first(n, scratch);
+
+	// the best candidate so far for each plan, as in Check::check_constraints
+	std::pmr::vector<Result> sr_results(n, scratch), best_results(n, scratch);
+	std::pmr::vector<short> best_passes(n, -1, scratch);
+	std::pmr::vector<uint8_t> done(n, 0, scratch);
+
+	match_restrictions(sid.restrictions, datetime, plans, engine_types.data(), aircraft_types.data(), first.data(), type_ok.data());
+	for (size_t i = 0; i < n; i++) {
+		Result unused;
+		sr_results[i] = restriction_result(sid.restrictions, first[i], unused);
+	}
+
+	for (const auto &constraint_ptr : sid.constraints) {
+		const api::Constraint &constraint = *constraint_ptr;
+
+		// destinations, matching packed prefixes of up to four characters
+		std::fill(dest_ok.begin(), dest_ok.end(), constraint.dests.empty());
+		std::fill(dest_banned.begin(), dest_banned.end(), 0);
+
+		for (const std::string &slug : constraint.dests)
+			if (slug.length() <= sizeof(uint32_t))
+				match_prefix(destinations.data(), n, pack(slug), pack_mask(slug.length()), dest_ok.data());
+
+		for (const std::string &slug : constraint.nodests)
+			if (slug.length() <= sizeof(uint32_t))
+				match_prefix(destinations.data(), n, pack(slug), pack_mask(slug.length()), dest_banned.data());
+
+		for (size_t i = 0; i < n; i++) dest_ok[i] &= !dest_banned[i];
+		for (size_t i : long_destinations) dest_ok[i] = destination_ok(constraint, plans[i].destination);
+
+		// exit points
+		if (points_packed) {
+			uint64_t white = 0, black = 0;
+			for (const std::string &point : constraint.points) white |= (uint64_t) 1 << point_ids[point];
+			for (const std::string &point : constraint.nopoints) black |= (uint64_t) 1 << point_ids[point];
+
+			match_points(point_sets.data(), n, white, black, exit_ok.data());
+		} else {
+			for (size_t i = 0; i < n; i++) exit_ok[i] = exit_point_ok(constraint, plans[i].points);
+		}
+
+		// levels
+		match_range(
+			levels.data(), n,
+			constraint.min ? (int32_t) *constraint.min : INT32_MIN,
+			constraint.max ? (int32_t) *constraint.max : INT32_MAX,
+			level_ok.data()
+		);
+
+		uint8_t parity = !constraint.dir ? 0
+			: *constraint.dir == api::Direction::Odd ? LEVEL_ODD : LEVEL_EVEN;
+
+		match_restrictions(constraint.restrictions, datetime, plans, engine_types.data(), aircraft_types.data(), first.data(), type_ok.data());
+		Result alerts = alert_result(constraint);
+
+		// the stages in order, counting those passed
+		auto evaluate = [&](size_t i, short &passes) {
+			if (!dest_ok[i]) return Result::Destination;
+			passes++;
+
+			if (!exit_ok[i]) return Result::ExitPoint;
+			passes++;
+
+			Result sr_result = sr_results[i];
+			Result result = restriction_result(constraint.restrictions, first[i], sr_result);
+			if (result != Result::Success) return result;
+			if (sr_result != Result::Success) return sr_result;
+			passes++;
+
+			if (!level_ok[i]) return Result::LevelBlock;
+			passes++;
+
+			if (!(level_bits[i] & LEVEL_SERIES)) return Result::LevelSeries;
+			if (parity && !(level_bits[i] & parity)) return Result::LevelParity;
+			passes++;
+
+			if (!route_ok(constraint, plans[i].route, sid_point, scratch)) return Result::Route;
+			passes++;
+
+			return alerts;
+		};
+
+		for (size_t i = 0; i < n; i++) {
+			if (done[i]) continue;
+
+			short passes = 0;
+			Result result = evaluate(i, passes);
+
+			if (result == Result::Success) {
+				results[i] = Result::Success;
+				done[i] = 1;
+			} else if (passes > best_passes[i]) {
+				best_passes[i] = passes;
+				best_results[i] = result;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < n; i++)
+		if (!done[i]) results[i] = best_results[i];
+}
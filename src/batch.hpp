@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory_resource>
+#include <string_view>
+
+#include "check.hpp"
+#include "flightplan.hpp"
+#include "source.hpp"
+
+// a flight plan which has passed the earlier stages of a check, with what is
+// needed to check it against the constraints of its SID
+struct BatchPlan {
+	std::string_view destination;
+	int cruise_level;
+	char engine_type, aircraft_type;
+	const char *sid_suffix;
+	Span<const std::string_view> points, route;
+};
+
+// checks many flight plans against the constraints of one SID, with the same
+// results as each would get from a single check. the plans are laid out in
+// columns, so that each constraint is compared against all of them at once,
+// using SSE2 where available. the SID must have at least one constraint.
+void check_constraints_batch(
+	const api::Sid &sid,
+	const char *sid_point,
+	const api::DateTime &datetime,
+	Span<const BatchPlan> plans,
+	Result *results,
+	std::pmr::memory_resource *scratch
+);
@@ -2,53 +2,191 @@
 #include <cstdint>
 #include <cstring>
 #include <functional>
+#include <map>
+#include <memory_resource>
 #include <regex>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 #include <spdlog/spdlog.h>
 
+#include "batch.hpp"
 #include "check.hpp"
 #include "source.hpp"
 
-Checker::Checker(Source &source) : source(source) {}
+// the fewest plans sharing a SID for which the columnar batch engine is used
+const size_t BATCH_COLUMNS_MIN = 16;
+
+const char *result_name(Result result) {
+	#define CASE(result) case Result::result: return #result;
+
+	switch (result) {
+		CASE(Success);
+		CASE(Warning);
+		CASE(NonIfr);
+		CASE(Pending);
+		CASE(Error);
+		CASE(Unknown);
+		CASE(Syntax);
+		CASE(SidUnknown);
+		CASE(CondBan);
+		CASE(CondFail);
+		CASE(Destination);
+		CASE(ExitPoint);
+		CASE(LevelBlock);
+		CASE(LevelParity);
+		CASE(LevelSeries);
+		CASE(Route);
+		CASE(CstrBan);
+	}
+
+	#undef CASE
+
+	return "";
+}
+
+const char *result_outcome(Result result) {
+	switch (result) {
+		case Result::Pending:
+		case Result::Error:
+			return "pending";
+
+		case Result::Unknown:
+		case Result::Success:
+		case Result::Warning:
+		case Result::NonIfr:
+			return "pass";
+
+		default:
+			return "fail";
+	}
+}
+
+static void append_log(std::string &log, std::string_view check_log, Result result) {
+	log.append(check_log);
+	log.append(result_outcome(result));
+}
+
+template<typename SourceType, typename FlightPlanType>
+BasicChecker<SourceType, FlightPlanType>::BasicChecker(SourceType &source) :
+	source(source), pool(std::pmr::pool_options { 0, 1 << 16 }) {}
 
-Result Checker::check(FlightPlan &fp, std::string *log) {
-	Check check(fp, source);
+template<typename SourceType, typename FlightPlanType>
+Result BasicChecker<SourceType, FlightPlanType>::check(FlightPlanType &fp, std::string *log, Source::Priority priority) {
+	// everything in the arena is released at once when it goes out of scope
+	std::pmr::monotonic_buffer_resource arena(arena_buffer, ARENA_SIZE, &pool);
+
+	BasicCheck<SourceType, FlightPlanType> check(fp, source, priority, &arena);
 	auto result = check.check();
 
-	if (log) {
-		log->append(check.log);
-
-		switch (result) {
-			case Result::Pending:
-			case Result::Error:
-				log->append("pending");
-				break;
-
-			case Result::Unknown:
-			case Result::Success:
-			case Result::Warning:
-			case Result::NonIfr:
-				log->append("pass");
-				break;
-
-			default:
-				log->append("fail");
-				break;
+	if (log) append_log(*log, check.log, result);
+
+	return result;
+}
+
+template<typename SourceType, typename FlightPlanType>
+std::vector<Result> BasicChecker<SourceType, FlightPlanType>::check_batch(
+	Span<FlightPlanType *const> fps,
+	std::vector<std::string> *logs,
+	Source::Priority priority
+) {
+	using Check = BasicCheck<SourceType, FlightPlanType>;
+
+	std::pmr::monotonic_buffer_resource arena(arena_buffer, ARENA_SIZE, &pool);
+	std::vector<Result> results(fps.size(), Result::Success);
+
+	std::pmr::vector<Check> checks(&arena);
+	checks.reserve(fps.size());
+	for (FlightPlanType *fp : fps)
+		checks.push_back(Check(*fp, source, priority, &arena));
+
+	// the time only matters to the precision of a minute, so is taken once
+	std::optional<api::DateTime> datetime;
+	std::pmr::map<std::string_view, Source::CacheStatus> statuses(&arena);
+	std::pmr::vector<size_t> parsed(&arena);
+
+	for (size_t i = 0; i < checks.size(); i++) {
+		Check &check = checks[i];
+
+		if ((results[i] = check.check_plan()) != Result::Success) continue;
+
+		auto status = statuses.find(check.origin);
+		if (status == statuses.end())
+			status = statuses.emplace(check.origin, source.airport(check.origin.data(), priority)).first;
+
+		if ((results[i] = check.check_origin(status->second)) != Result::Success) continue;
+		if ((results[i] = check.check_syntax()) != Result::Success) continue;
+
+		if (!datetime) datetime = source.datetime();
+		check.datetime = datetime;
+
+		parsed.push_back(i);
+	}
+
+	auto key = [&checks](size_t i) {
+		return std::make_pair(checks[i].origin, std::string_view(checks[i].sid_point));
+	};
+
+	std::stable_sort(parsed.begin(), parsed.end(), [&key](size_t a, size_t b) {
+		return key(a) < key(b);
+	});
+
+	for (auto group = parsed.begin(); group != parsed.end();) {
+		auto group_end = std::find_if(group, parsed.end(), [&](size_t i) { return key(i) != key(*group); });
+		auto sid_data = source.sid(checks[*group].origin.data(), checks[*group].sid_point);
+
+		// without logs to write, large enough groups are checked in columns
+		if (!logs && sid_data && !sid_data->constraints.empty() && (size_t) (group_end - group) >= BATCH_COLUMNS_MIN) {
+			std::pmr::vector<BatchPlan> plans(&arena);
+			std::pmr::vector<Result> group_results(group_end - group, &arena);
+
+			for (auto i = group; i != group_end; i++) {
+				Check &check = checks[*i];
+				plans.push_back(BatchPlan {
+					check.destination, check.fp.cruise_level(),
+					check.fp.engine_type(), check.fp.aircraft_type(),
+					check.sid_suffix, check.fp.points(), check.bare_route,
+				});
+			}
+
+			check_constraints_batch(*sid_data, checks[*group].sid_point, *datetime, plans, group_results.data(), &arena);
+
+			for (Result result : group_results) results[*group++] = result;
+			continue;
 		}
+
+		for (; group != group_end; group++)
+			results[*group] = checks[*group].check_sid(sid_data.get());
 	}
 
-	return result;
+	if (logs) {
+		logs->assign(checks.size(), std::string());
+		for (size_t i = 0; i < checks.size(); i++)
+			append_log((*logs)[i], checks[i].log, results[i]);
+	}
+
+	return results;
 }
 
-Check::Check(FlightPlan &fp, Source &source) : fp(fp), source(source) {}
+template<typename SourceType, typename FlightPlanType>
+BasicCheck<SourceType, FlightPlanType>::BasicCheck(
+	FlightPlanType &fp,
+	SourceType &source,
+	Source::Priority priority,
+	std::pmr::memory_resource *scratch
+) :
+	source(source), scratch(scratch), log(scratch), fp(fp), priority(priority), bare_route(scratch) {}
 
 #define LOG(msg) { log.append(msg); log.append("; "); }
 
-void to_upper(std::string &s) {
-	std::transform(s.cbegin(), s.cend(), s.begin(), toupper);
+static std::string_view view(const std::csub_match &sub) {
+	return std::string_view(sub.first, sub.length());
+}
+
+static bool regex_match(std::string_view token, std::pmr::cmatch &match, const std::regex &regex) {
+	return std::regex_match(token.data(), token.data() + token.size(), match, regex);
 }
 
 const std::regex
@@ -58,23 +196,38 @@ const std::regex
 	regex_ats(R"#(^([A-Z]{2,5}\d[A-Z]?|[USK]?[A-Z][1-9]\d{0,2}[A-Z]?|NAT[A-Z]|DCT)$)#", std::regex::optimize),
 	regex_wpt(R"#(^([A-Z]{2,5}(\d{6})?|\d{2}(\d{2})?[SN]\d{3}(\d{2})?[WE])($|\/))#", std::regex::optimize);
 
-Result Check::check() {
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check() {
+	Result result;
+
+	if ((result = check_plan()) != Result::Success) return result;
+	if ((result = check_origin(source.airport(origin.data(), priority))) != Result::Success) return result;
+	if ((result = check_syntax()) != Result::Success) return result;
+
+	return check_sid(source.sid(origin.data(), sid_point).get());
+}
+
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_plan() {
 	if (!fp.is_ifr()) {
 		LOG("plan type is not IFR");
 		return Result::NonIfr;
 	}
 
-	const char *c_origin = fp.departure(), *c_destination = fp.destination();
-	if (!c_origin || !c_origin[0] || !c_destination || !c_destination[0]) {
+	origin = fp.departure();
+	destination = fp.destination();
+
+	if (origin.empty() || destination.empty()) {
 		LOG("origin/destination is missing");
 		return Result::Syntax;
 	}
 
-	std::string origin(c_origin), destination(c_destination);
-	to_upper(origin);
-	to_upper(destination);
+	return Result::Success;
+}
 
-	switch (source.airport(origin.c_str())) {
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_origin(Source::CacheStatus status) {
+	switch (status) {
 		case Source::CacheStatus::Pending:
 			LOG("loading data for origin");
 			return Result::Pending;
@@ -91,59 +244,46 @@ Result Check::check() {
 			break;
 	}
 
-	const char *route_raw = fp.route();
-	std::vector<std::string> route, points = fp.points();
-
-	while (route_raw) {
-		route_raw += strspn(route_raw, " ");
-		if (!route_raw[0]) break;
-
-		const char *next = strchr(route_raw, ' ');
-
-		std::string segment;
-		if (next) segment = std::string(route_raw, next - route_raw);
-		else segment = std::string(route_raw);
-
-		to_upper(segment);
-		route.push_back(std::move(segment));
+	return Result::Success;
+}
 
-		route_raw = next;
-	}
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_syntax() {
+	auto route = fp.route();
 
 	if (route.empty()) {
 		LOG("empty route");
 		return Result::Syntax;
 	}
 
-	std::string sid = fp.sid_name(), sid_suffix, sid_point;
-	to_upper(sid);
+	std::string_view sid = fp.sid_name(), suffix, point;
 
 	if (!sid.empty()) {
 		// remove prefix for legacy SIDs
-		if (sid[0] == '#') sid.erase(0, 1);
+		if (sid[0] == '#') sid.remove_prefix(1);
 
 		if (origin == "EGLL" && sid == "CHK") {
 			// ridiculous, copied from old vFPC
-			sid_suffix = "CHK";
-			sid_point = "CPT";
-		} else {
-			sid_suffix = sid.back();
-			sid_point = sid.substr(0, strcspn(sid.c_str(), "0123456789"));
+			suffix = "CHK";
+			point = "CPT";
+		} else if (!sid.empty()) {
+			suffix = sid.substr(sid.size() - 1);
+			point = sid.substr(0, std::min(sid.find_first_of("0123456789"), sid.size()));
 		}
 	}
 
-	auto route_iter = route.cbegin();
-	std::smatch match;
+	auto route_iter = route.begin();
+	std::pmr::cmatch match(scratch);
 
-	if (std::regex_match(*route_iter, regex_csl)) route_iter++;
+	if (regex_match(*route_iter, match, regex_csl)) route_iter++;
 
-	if (route_iter == route.cend()) {
+	if (route_iter == route.end()) {
 		LOG("route contains no route");
 		return Result::Syntax;
 	}
 
-	if (std::regex_match(*route_iter, match, regex_apt)) {
-		if (match[1].str() != origin) {
+	if (regex_match(*route_iter, match, regex_apt)) {
+		if (view(match[1]) != origin) {
 			LOG("route and flight plan origin do not match");
 			return Result::Syntax;
 		}
@@ -151,31 +291,32 @@ Result Check::check() {
 		route_iter++;
 	}
 
-	if (route_iter != route.cend() && std::regex_match(*route_iter, regex_csl))
+	if (route_iter != route.end() && regex_match(*route_iter, match, regex_csl))
 		route_iter++;
 
-	std::vector<std::string> bare_route;
+	bare_route.clear();
 
-	while (route_iter != route.cend()) {
+	while (route_iter != route.end()) {
 		// really, this should be mandatory, but it is often omitted on VATSIM
-		if (std::regex_match(*route_iter, regex_ats)) {
+		if (regex_match(*route_iter, match, regex_ats)) {
 			if (*route_iter != "DCT") bare_route.push_back(*route_iter);
 			route_iter++;
 		}
 
-		if (route_iter == route.cend()) break;
-		if (std::regex_match(*route_iter, regex_apt)) break;
+		if (route_iter == route.end()) break;
+		if (regex_match(*route_iter, match, regex_apt)) break;
 
-		bool climb = !(*route_iter).compare(0, 2, "C/");
-		auto begin = (*route_iter).begin() + (climb ? 2 : 0);
+		bool climb = !route_iter->compare(0, 2, "C/");
+		const char *begin = route_iter->data() + (climb ? 2 : 0),
+			*end = route_iter->data() + route_iter->size();
 
-		if (std::regex_search(begin, (*route_iter).end(), match, regex_wpt)) {
-			bare_route.push_back(match[1].str());
+		if (std::regex_search(begin, end, match, regex_wpt)) {
+			bare_route.push_back(view(match[1]));
 
 			begin = match.suffix().first;
 
-			if (begin != (*route_iter).end()) {
-				if (!std::regex_match(begin, (*route_iter).end(), climb ? regex_clb : regex_csl)) {
+			if (begin != end) {
+				if (!std::regex_match(begin, end, match, climb ? regex_clb : regex_csl)) {
 					LOG("invalid change of speed/level");
 					return Result::Syntax;
 				}
@@ -190,8 +331,8 @@ Result Check::check() {
 		// if we were to support changes of flight rules, it would be inserted here
 	}
 
-	if (route_iter != route.cend() && std::regex_match(*route_iter, match, regex_apt)) {
-		if (match[1].str() != destination) {
+	if (route_iter != route.end() && regex_match(*route_iter, match, regex_apt)) {
+		if (view(match[1]) != destination) {
 			LOG("route and flight plan destination do not match");
 			return Result::Syntax;
 		}
@@ -199,18 +340,136 @@ Result Check::check() {
 		route_iter++;
 	}
 
-	if (route_iter != route.cend()) {
+	if (route_iter != route.end()) {
 		LOG("invalid token in flight plan");
 		return Result::Syntax;
 	}
 
-	auto sid_data = source.sid(origin.c_str(), sid_point.c_str());
+	// the point and suffix are slices of the SID name, so are copied to be
+	// terminated. no real SID comes near these lengths.
+	if (point.size() >= sizeof sid_point || suffix.size() >= sizeof sid_suffix) {
+		LOG("departure not in database");
+		return Result::SidUnknown;
+	}
+
+	sid_point[point.copy(sid_point, point.size())] = '\0';
+	sid_suffix[suffix.copy(sid_suffix, suffix.size())] = '\0';
+
+	return Result::Success;
+}
+
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_sid(const api::Sid *sid_data) {
 	if (!sid_data) {
 		LOG("departure not in database");
 		return Result::SidUnknown;
 	}
 
-	return check_constraints(*sid_data, sid_point.c_str(), sid_suffix.c_str(), points, bare_route);
+	return check_constraints(*sid_data, sid_point, sid_suffix, fp.points(), bare_route);
+}
+
+bool restriction_in_time(const api::Restriction &restriction, const api::DateTime &datetime) {
+	if (!restriction.start || !restriction.end || !datetime.time) return true;
+
+	if (restriction.start->date && restriction.end->date) {
+		bool time_check[2] = { false, false };
+
+		uint8_t
+			date_min = std::min(*restriction.start->date, *restriction.end->date),
+			date_max = std::max(*restriction.start->date, *restriction.end->date);
+		bool
+			wrap = *restriction.start->date > *restriction.end->date,
+			cont = date_min < *datetime.date && *datetime.date < date_max;
+
+		if (date_min == *datetime.date) time_check[wrap] = true;
+		if (date_max == *datetime.date) time_check[1 - wrap] = true;
+
+		if (wrap == cont && !time_check[0] && !time_check[1]) return false;
+
+		if (restriction.start->time && restriction.end->time) {
+			uint16_t
+				time_start = restriction.start->time->ord(),
+				time_end   = restriction.end->time->ord();
+
+			if (time_check[0] && time_start > datetime.time->ord()) return false;
+			if (time_check[1] && time_end   < datetime.time->ord()) return false;
+		}
+	} else if (restriction.start->time && restriction.end->time) {
+		uint16_t
+			time_start = restriction.start->time->ord(),
+			time_end   = restriction.end->time->ord(),
+			time_min = std::min(time_start, time_end),
+			time_max = std::max(time_start, time_end);
+		bool
+			wrap = time_start > time_end,
+			cont = time_min < datetime.time->ord() && datetime.time->ord() < time_max;
+
+		if (wrap == cont) return false;
+	}
+
+	return true;
+}
+
+bool restriction_has_suffix(const api::Restriction &restriction, const char *sid_suffix) {
+	if (restriction.suffix.empty()) return true;
+
+	return std::any_of(
+		restriction.suffix.begin(), restriction.suffix.end(),
+		[sid_suffix](const std::string &suffix) {
+			if (suffix.length() > strlen(sid_suffix)) return false;
+
+			size_t offset = strlen(sid_suffix) - suffix.length();
+			return !strcmp(suffix.c_str(), sid_suffix + offset);
+		}
+	);
+}
+
+bool restriction_has_type(const api::Restriction &restriction, char engine_type, char aircraft_type) {
+	if (restriction.types.empty()) return true;
+
+	return std::any_of(
+		restriction.types.begin(), restriction.types.end(),
+		[engine_type, aircraft_type](const std::string &type) {
+			return type.length() == 1 && (type[0] == engine_type || type[0] == aircraft_type);
+		}
+	);
+}
+
+bool route_matches(
+	const std::string &candidate,
+	Span<const std::string_view> route,
+	const char *sid_point,
+	std::pmr::memory_resource *scratch
+) {
+	if (candidate == "*") return true;
+
+	std::pmr::vector<std::string_view> candidate_route(scratch);
+	size_t cursor = 0, start = cursor;
+
+	do {
+		cursor = std::min(candidate.find(' ', cursor), candidate.size());
+		candidate_route.push_back(std::string_view(candidate).substr(start, cursor - start));
+	} while (cursor != candidate.size() && (start = ++cursor) != candidate.size());
+
+	if (candidate_route.empty() != route.empty()) return false;
+
+	auto ccursor = candidate_route.cbegin();
+	auto rcursor = route.begin();
+
+	if (*sid_point) {
+		// skip the parts before the first common waypoint, or reject if disjoint
+		while (rcursor != route.end() && *rcursor != candidate_route[0]) rcursor++;
+		if (rcursor == route.end()) return false;
+	}
+
+	while (ccursor != candidate_route.cend()) {
+		if (rcursor == route.end()) return false;
+		if (*ccursor != *rcursor && *ccursor != "*") return false;
+
+		ccursor++; rcursor++;
+	}
+
+	return true;
 }
 
 struct Candidate {
@@ -218,17 +477,19 @@ struct Candidate {
 
 	short passes = 0;
 	Result result = Result::Success;
-	std::string log;
+	std::pmr::string log;
 
-	Candidate(const api::Constraint &constraint) : constraint(constraint) {}
+	Candidate(const api::Constraint &constraint, std::pmr::memory_resource *scratch) :
+		constraint(constraint), log(scratch) {}
 };
 
-Result Check::check_constraints(
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_constraints(
 	const api::Sid &sid_data,
 	const char *sid_point,
 	const char *sid_suffix,
-	const std::vector<std::string> &points,
-	const std::vector<std::string> &route
+	Span<const std::string_view> points,
+	const std::pmr::vector<std::string_view> &route
 ) {
 	Result sr_result = check_restrictions(sid_data.restrictions, sid_suffix);
 
@@ -236,9 +497,11 @@ Result Check::check_constraints(
 	// passes (ordered semantically) is selected as the canonical failure. since
 	// the log pointer is global (meh) some nonsense is required.
 
-	std::vector<Candidate> candidates;
+	// the logs are swapped with the check's, so must share its allocator
+	std::pmr::vector<Candidate> candidates(scratch);
+	candidates.reserve(sid_data.constraints.size());
 	for (const auto &constraint : sid_data.constraints)
-		candidates.push_back(std::move(Candidate(constraint)));
+		candidates.emplace_back(*constraint, scratch);
 
 	#define CHECK(check) \
 		candidate.result = check; \
@@ -295,9 +558,10 @@ Result Check::check_constraints(
 	return best.result;
 }
 
-Result Check::check_destination(const api::Constraint &constraint, const char *dest) {
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_destination(const api::Constraint &constraint, std::string_view dest) {
 	auto predicate = [dest](const std::string &slug) {
-		return !strncmp(slug.c_str(), dest, slug.length());
+		return dest.substr(0, slug.length()) == slug;
 	};
 
 	if (
@@ -319,7 +583,8 @@ Result Check::check_destination(const api::Constraint &constraint, const char *d
 	return Result::Success;
 }
 
-Result Check::check_exit_point(const api::Constraint &constraint, const std::vector<std::string> &points) {
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_exit_point(const api::Constraint &constraint, Span<const std::string_view> points) {
 	auto predicate = [points](const std::string &exit_point) {
 		return std::find(points.begin(), points.end(), exit_point) != points.end();
 	};
@@ -343,7 +608,8 @@ Result Check::check_exit_point(const api::Constraint &constraint, const std::vec
 	return Result::Success;
 }
 
-Result Check::check_min_max(const api::Constraint &constraint, int rfl) {
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_min_max(const api::Constraint &constraint, int rfl) {
 	rfl /= 100;
 
 	if (constraint.min && *constraint.min > rfl) {
@@ -359,9 +625,8 @@ Result Check::check_min_max(const api::Constraint &constraint, int rfl) {
 	return Result::Success;
 }
 
-const int RVSM_START = 41;
-
-Result Check::check_direction(const api::Constraint &constraint, int rfl) {
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_direction(const api::Constraint &constraint, int rfl) {
 	if (rfl % 1000) {
 		LOG("requested level not IFR");
 		return Result::LevelSeries;
@@ -386,40 +651,14 @@ Result Check::check_direction(const api::Constraint &constraint, int rfl) {
 	return Result::Success;
 }
 
-Result Check::check_route(
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_route(
 	const api::Constraint &constraint,
-	const std::vector<std::string> &route,
+	const std::pmr::vector<std::string_view> &route,
 	const char *sid_point
 ) {
-	auto predicate = [route, sid_point](const std::string &candidate) {
-		if (candidate == "*") return true;
-
-		std::vector<std::string> candidate_route;
-		auto cursor = candidate.cbegin(), start = cursor;
-
-		do {
-			cursor = std::find(cursor, candidate.cend(), ' ');
-			candidate_route.push_back(std::string(start, cursor));
-		} while (cursor != candidate.cend() && (start = ++cursor) != candidate.cend());
-
-		if (candidate_route.empty() != route.empty()) return false;
-
-		auto ccursor = candidate_route.cbegin(), rcursor = route.cbegin();
-
-		if (*sid_point) {
-			// skip the parts before the first common waypoint, or reject if disjoint
-			while (rcursor != route.cend() && *rcursor != candidate_route[0]) rcursor++;
-			if (rcursor == route.cend()) return false;
-		}
-
-		while (ccursor != candidate_route.cend()) {
-			if (rcursor == route.cend()) return false;
-			if (*ccursor != *rcursor && strcmp(ccursor->c_str(), "*")) return false;
-
-			ccursor++; rcursor++;
-		}
-
-		return true;
+	auto predicate = [this, &route, sid_point](const std::string &candidate) {
+		return route_matches(candidate, route, sid_point, scratch);
 	};
 
 	if (
@@ -441,12 +680,13 @@ Result Check::check_route(
 	return Result::Success;
 }
 
-Result Check::check_alerts(const api::Constraint &constraint) {
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_alerts(const api::Constraint &constraint) {
 	Result result = Result::Success;
 
 	for (const api::Alert &alert : constraint.alerts) {
 		if (alert.ban) {
-			std::string message("candidate is banned");
+			std::pmr::string message("candidate is banned", scratch);
 			if (alert.note) {
 				message.append(": ");
 				message.append(alert.note->c_str());
@@ -457,7 +697,7 @@ Result Check::check_alerts(const api::Constraint &constraint) {
 		}
 
 		if (alert.warn) {
-			std::string message("candidate contains warning");
+			std::pmr::string message("candidate contains warning", scratch);
 			if (alert.note) {
 				message.append(": ");
 				message.append(alert.note->c_str());
@@ -471,7 +711,8 @@ Result Check::check_alerts(const api::Constraint &constraint) {
 	return result;
 }
 
-Result Check::check_restrictions(
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_restrictions(
 	const std::vector<api::Restriction> &restrictions,
 	const char *sid_suffix
 ) {
@@ -479,80 +720,22 @@ Result Check::check_restrictions(
 	return check_restrictions(restrictions, sid_suffix, unused);
 }
 
-Result Check::check_restrictions(
+template<typename SourceType, typename FlightPlanType>
+Result BasicCheck<SourceType, FlightPlanType>::check_restrictions(
 	const std::vector<api::Restriction> &restrictions,
 	const char *sid_suffix,
 	Result &sr_result
 ) {
 	if (restrictions.empty()) return Result::Success;
 
-	auto datetime = source.datetime();
+	if (!datetime) datetime = source.datetime();
 
 	for (const api::Restriction &restriction : restrictions) {
-		if (restriction.start && restriction.end && datetime.time) {
-			if (restriction.start->date && restriction.end->date) {
-				bool time_check[2];
-
-				uint8_t
-					date_min = std::min(*restriction.start->date, *restriction.end->date),
-					date_max = std::max(*restriction.start->date, *restriction.end->date);
-				bool
-					wrap = *restriction.start->date > *restriction.end->date,
-					cont = date_min < *datetime.date && *datetime.date < date_max;
-
-				if (date_min == *datetime.date) time_check[wrap] = true;
-				if (date_max == *datetime.date) time_check[1 - wrap] = true;
-
-				if (wrap == cont && !time_check[0] && !time_check[1]) continue;
-
-				if (restriction.start->time && restriction.end->time) {
-					uint16_t
-						time_start = restriction.start->time->ord(),
-						time_end   = restriction.end->time->ord();
-
-					if (time_check[0] && time_start > datetime.time->ord()) continue;
-					if (time_check[1] && time_end   < datetime.time->ord()) continue;
-				}
-			} else if (restriction.start->time && restriction.end->time) {
-				uint16_t
-					time_start = restriction.start->time->ord(),
-					time_end   = restriction.end->time->ord(),
-					time_min = std::min(time_start, time_end),
-					time_max = std::max(time_start, time_end);
-				bool
-					wrap = time_start > time_end,
-					cont = time_min < datetime.time->ord() && datetime.time->ord() < time_max;
-
-				if (wrap == cont) continue;
-			}
-		}
-
-		if (!restriction.suffix.empty()) {
-			if (
-				std::none_of(
-					restriction.suffix.begin(), restriction.suffix.end(),
-					[sid_suffix](const std::string &suffix) {
-						if (suffix.length() > strlen(sid_suffix)) return false;
-
-						size_t offset = strlen(sid_suffix) - suffix.length();
-						return !strcmp(suffix.c_str(), sid_suffix + offset);
-					}
-				)
-			) continue;
-		}
-
-		if (!restriction.types.empty()) {
-			if (
-				std::find(
-					restriction.types.begin(), restriction.types.end(),
-					std::string(1, fp.engine_type())
-				) == restriction.types.end() &&
-				std::find(
-					restriction.types.begin(), restriction.types.end(),
-					std::string(1, fp.aircraft_type())
-				) == restriction.types.end()
-			) continue;
-		}
+		if (
+			!restriction_in_time(restriction, *datetime) ||
+			!restriction_has_suffix(restriction, sid_suffix) ||
+			!restriction_has_type(restriction, fp.engine_type(), fp.aircraft_type())
+		) continue;
 
 		if (restriction.banned) {
 			LOG("banned condition matches");
@@ -571,8 +754,9 @@ Result Check::check_restrictions(
 	return Result::CondFail;
 }
 
-void Check::log_alternatives(const std::vector<api::Restriction> &restrictions) {
-	std::string alternatives("alternatives exist (");
+template<typename SourceType, typename FlightPlanType>
+void BasicCheck<SourceType, FlightPlanType>::log_alternatives(const std::vector<api::Restriction> &restrictions) {
+	std::pmr::string alternatives("alternatives exist (", scratch);
 	auto length = alternatives.length();
 
 	for (const api::Restriction &restriction : restrictions) {
@@ -587,3 +771,9 @@ void Check::log_alternatives(const std::vector<api::Restriction> &restrictions)
 		LOG(alternatives);
 	}
 }
+
+template class BasicChecker<Source, FlightPlan>;
+
+#ifdef VFPC_STANDALONE
+template class BasicChecker<StaticSource, IcaoFlightPlan>;
+#endif
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "flightplan.hpp"
 #include "source.hpp"
@@ -27,34 +32,87 @@ enum class Result {
 	CstrBan
 };
 
-class Checker {
+// the name of the result, as in the enumeration
+const char *result_name(Result);
+// "pass", "fail" or "pending", with which the log of a check ends
+const char *result_outcome(Result);
+
+const int RVSM_START = 41;
+
+// parts of a check which the batch engine shares
+
+bool restriction_in_time(const api::Restriction &, const api::DateTime &);
+bool restriction_has_suffix(const api::Restriction &, const char *sid_suffix);
+bool restriction_has_type(const api::Restriction &, char engine_type, char aircraft_type);
+bool route_matches(const std::string &candidate, Span<const std::string_view> route, const char *sid_point, std::pmr::memory_resource *);
+
+// checks flight plans against a source. the types may be concrete (and final)
+// for calls to them to be bound statically; Checker is the instantiation over
+// the interfaces. instantiations are explicit, in check.cpp.
+template<typename SourceType, typename FlightPlanType>
+class BasicChecker {
 private:
-	Source &source;
+	SourceType &source;
+
+	// scratch for each check is taken from an arena over this buffer, and any
+	// overflow from the pool, which keeps it for later checks
+	static const size_t ARENA_SIZE = 8192;
+	alignas(std::max_align_t) std::byte arena_buffer[ARENA_SIZE];
+	std::pmr::unsynchronized_pool_resource pool;
 
 public:
-	Checker(Source &);
+	BasicChecker(SourceType &);
 
-	Result check(FlightPlan &, std::string * = nullptr);
+	Result check(FlightPlanType &, std::string * = nullptr, Source::Priority = Source::Priority::Visible);
+
+	// checks many flight plans, looking up each origin and SID once for all the
+	// plans which share it. results (and logs, if given) are in input order.
+	std::vector<Result> check_batch(
+		Span<FlightPlanType *const>,
+		std::vector<std::string> * = nullptr,
+		Source::Priority = Source::Priority::Visible
+	);
 };
 
-class Check {
-	friend class Checker;
+using Checker = BasicChecker<Source, FlightPlan>;
+
+#ifdef VFPC_STANDALONE
+using StaticChecker = BasicChecker<StaticSource, IcaoFlightPlan>;
+#endif
+
+template<typename SourceType, typename FlightPlanType>
+class BasicCheck {
+	friend class BasicChecker<SourceType, FlightPlanType>;
 
 private:
-	Source &source;
-	std::string log;
-	FlightPlan &fp;
+	SourceType &source;
+	std::pmr::memory_resource *scratch;
+	std::pmr::string log;
+	FlightPlanType &fp;
+	Source::Priority priority;
 
-	Check(FlightPlan &, Source &);
+	// state passed between the stages of a check
+	std::string_view origin, destination;
+	char sid_point[16], sid_suffix[4];
+	std::pmr::vector<std::string_view> bare_route;
+	std::optional<api::DateTime> datetime;
+
+	BasicCheck(FlightPlanType &, SourceType &, Source::Priority, std::pmr::memory_resource *);
 
 	Result check();
 
-	Result check_constraints(const api::Sid &, const char *, const char *, const std::vector<std::string> &, const std::vector<std::string> &);
-	Result check_destination(const api::Constraint &, const char *);
-	Result check_exit_point (const api::Constraint &, const std::vector<std::string> &);
+	// the stages of a check, each of which must succeed for the next to run
+	Result check_plan();
+	Result check_origin(Source::CacheStatus);
+	Result check_syntax();
+	Result check_sid(const api::Sid *);
+
+	Result check_constraints(const api::Sid &, const char *, const char *, Span<const std::string_view>, const std::pmr::vector<std::string_view> &);
+	Result check_destination(const api::Constraint &, std::string_view);
+	Result check_exit_point (const api::Constraint &, Span<const std::string_view>);
 	Result check_min_max    (const api::Constraint &, int);
 	Result check_direction  (const api::Constraint &, int);
-	Result check_route      (const api::Constraint &, const std::vector<std::string> &, const char *);
+	Result check_route      (const api::Constraint &, const std::pmr::vector<std::string_view> &, const char *);
 	Result check_alerts     (const api::Constraint &);
 
 	Result check_restrictions(const std::vector<api::Restriction> &, const char *);
@@ -0,0 +1,100 @@
+#ifndef VFPC_STANDALONE
+#error Cannot compile daemon in default plugin mode!
+#endif
+
+#include <sstream>
+#include <string>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#include "check.hpp"
+#include "daemon.hpp"
+#include "flightplan.hpp"
+#include "server.hpp"
+
+using json = nlohmann::json;
+
+// pipelined responses are written once this many bytes are waiting
+const size_t FLUSH_SIZE = 16 * 1024;
+
+// answers one request of the form {"id": ..., "plan": "(FPL-...)", "logs": true},
+// echoing the id, which may be any value
+static std::string handle(StaticSource &source, StaticChecker &checker, const std::string &line) {
+	json request = json::parse(line, nullptr, false), response = { { "id", nullptr } };
+
+	if (!request.is_object()) {
+		response["error"] = "bad request";
+		return response.dump();
+	}
+
+	if (request.contains("id")) response["id"] = request["id"];
+
+	auto plan = request.find("plan");
+	if (plan == request.end() || !plan->is_string()) {
+		response["error"] = "bad request";
+		return response.dump();
+	}
+
+	bool logs = request.contains("logs") && request["logs"] == true;
+
+	// the message may span lines, which are joined as for the other modes
+	std::istringstream lines(plan->get_ref<const std::string &>());
+	std::string plan_line, fp_src;
+	while (std::getline(lines, plan_line)) {
+		if (!plan_line.empty() && plan_line.back() == '\r') plan_line.pop_back();
+		fp_src.append(plan_line);
+	}
+
+	try {
+		IcaoFlightPlan fp(fp_src.c_str());
+		source.set_datetime(fp.dof_eobt());
+
+		std::string log;
+		Result result = checker.check(fp, logs ? &log : nullptr);
+
+		response["callsign"] = fp.callsign();
+		response["result"] = result_name(result);
+		response["outcome"] = result_outcome(result);
+		if (logs) response["log"] = log;
+	} catch (const char *error) {
+		response["error"] = error;
+	} catch (...) {
+		response["error"] = "bad format";
+	}
+
+	return response.dump();
+}
+
+Daemon::Daemon(const char *rules_path) : rules(rules_path, {}) {}
+
+void Daemon::serve(int fd) {
+	SocketReader reader(fd);
+	std::string line, responses;
+
+	// each connection checks with its own source and checker, sharing the rules
+	StaticSource source(rules, {});
+	StaticChecker checker(source);
+
+	while (reader.read_until("\n", line)) {
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line.empty()) continue;
+
+		responses.append(handle(source, checker, line));
+		responses.push_back('\n');
+
+		// pipelined requests are answered together, once those already read have
+		// been handled, or enough have built up
+		if (reader.buffered("\n") && responses.length() < FLUSH_SIZE) continue;
+
+		if (!write_all(fd, responses.data(), responses.length())) return;
+		responses.clear();
+	}
+}
+
+void Daemon::run(const char *path) {
+	auto server = Server::unix_domain(path, [this](int fd) { serve(fd); });
+
+	spdlog::info("validating flight plans on {}", path);
+	server.run();
+}
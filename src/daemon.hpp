@@ -0,0 +1,23 @@
+#pragma once
+
+#ifndef VFPC_STANDALONE
+#error Cannot compile daemon in default plugin mode!
+#endif
+
+#include "source.hpp"
+
+// validates flight plans sent over a Unix domain socket, against rules loaded
+// once. requests and responses are JSON lines, and a connection may pipeline
+// requests, which are answered in order.
+class Daemon {
+private:
+	StaticSource rules;
+
+	void serve(int fd);
+
+public:
+	Daemon(const char *rules_path);
+
+	// serves on the socket at the path forever
+	[[noreturn]] void run(const char *path);
+};
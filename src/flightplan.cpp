@@ -1,43 +1,108 @@
 #include "flightplan.hpp"
 
+#include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <ctime>
 
+template<typename String>
+static std::string_view normalise(String &buffer) {
+	std::transform(buffer.cbegin(), buffer.cend(), buffer.begin(), [](unsigned char c) {
+		return (char) toupper(c);
+	});
+
+	return buffer;
+}
+
+// normalises the buffer and splits it into its space-separated tokens, each of
+// which is terminated in place
+template<typename String, typename Vector>
+static void tokenise(String &buffer, Vector &tokens) {
+	normalise(buffer);
+	tokens.clear();
+
+	size_t start = 0, end;
+	while ((start = buffer.find_first_not_of(' ', start)) != String::npos) {
+		end = std::min(buffer.find(' ', start), buffer.size());
+		if (end < buffer.size()) buffer[end] = '\0';
+
+		tokens.emplace_back(buffer.data() + start, end - start);
+		start = end + 1;
+	}
+}
+
 #ifndef VFPC_STANDALONE
-EuroScopeFlightPlan::EuroScopeFlightPlan(const FlightPlan &fp) : fp(fp) {}
+EuroScopeFlightPlan::EuroScopeFlightPlan(const FlightPlan &fp, std::pmr::memory_resource *memory) :
+	fp(fp),
+	departure_(memory), destination_(memory), sid_name_(memory),
+	route_buffer_(memory), points_buffer_(memory),
+	route_(memory), points_(memory) {}
 
 bool EuroScopeFlightPlan::is_ifr() {
 	return fp.GetFlightPlanData().GetPlanType()[0] == 'I';
 }
 
-const char *EuroScopeFlightPlan::departure() {
-	return fp.GetFlightPlanData().GetOrigin();
+std::string_view EuroScopeFlightPlan::departure() {
+	if (!departure_loaded) {
+		departure_ = fp.GetFlightPlanData().GetOrigin();
+		normalise(departure_);
+		departure_loaded = true;
+	}
+
+	return departure_;
 }
 
-const char *EuroScopeFlightPlan::destination() {
-	return fp.GetFlightPlanData().GetDestination();
+std::string_view EuroScopeFlightPlan::destination() {
+	if (!destination_loaded) {
+		destination_ = fp.GetFlightPlanData().GetDestination();
+		normalise(destination_);
+		destination_loaded = true;
+	}
+
+	return destination_;
 }
 
 int EuroScopeFlightPlan::cruise_level() {
 	return fp.GetFlightPlanData().GetFinalAltitude();
 }
 
-const char *EuroScopeFlightPlan::route() {
-	return fp.GetFlightPlanData().GetRoute();
+Span<const std::string_view> EuroScopeFlightPlan::route() {
+	if (!route_loaded) {
+		route_buffer_ = fp.GetFlightPlanData().GetRoute();
+		tokenise(route_buffer_, route_);
+		route_loaded = true;
+	}
+
+	return route_;
 }
 
-std::vector<std::string> EuroScopeFlightPlan::points() {
-	auto exroute = fp.GetExtractedRoute();
-	std::vector<std::string> ret;
+Span<const std::string_view> EuroScopeFlightPlan::points() {
+	if (!points_loaded) {
+		auto exroute = fp.GetExtractedRoute();
+
+		// point names can't contain spaces, so they're joined and split again to
+		// be held in a single buffer
+		points_buffer_.clear();
+		for (int i = 0; i < exroute.GetPointsNumber(); i++) {
+			points_buffer_.append(exroute.GetPointName(i));
+			points_buffer_.push_back(' ');
+		}
 
-	for (int i = 0; i < exroute.GetPointsNumber(); i++)
-		ret.push_back(std::string(exroute.GetPointName(i)));
+		tokenise(points_buffer_, points_);
+		points_loaded = true;
+	}
 
-	return ret;
+	return points_;
 }
 
-const char *EuroScopeFlightPlan::sid_name() {
-	return fp.GetFlightPlanData().GetSidName();
+std::string_view EuroScopeFlightPlan::sid_name() {
+	if (!sid_name_loaded) {
+		sid_name_ = fp.GetFlightPlanData().GetSidName();
+		normalise(sid_name_);
+		sid_name_loaded = true;
+	}
+
+	return sid_name_;
 }
 
 char EuroScopeFlightPlan::engine_type() {
@@ -108,6 +173,7 @@ IcaoFlightPlan::IcaoFlightPlan(const char *fp) {
 
 	confirm(end - fp >= 8);
 	departure_ = std::string(fp, 4);
+	normalise(departure_);
 	dof_eobt_.time.emplace();
 	dof_eobt_.time->hour   = std::stoi(std::string(fp + 4, 2));
 	dof_eobt_.time->minute = std::stoi(std::string(fp + 6, 2));
@@ -122,17 +188,20 @@ IcaoFlightPlan::IcaoFlightPlan(const char *fp) {
 	cruise_level_ = std::stoi(std::string(sub, trunc - sub)) * 100;
 
 	sub = trunc + 1;
-	route_ = std::string(sub, end - sub);
+	route_buffer_ = std::string(sub, end - sub);
+	tokenise(route_buffer_, route_);
 
 	trunc = strchr(sub, ' ');
 	if (!trunc || trunc > end) trunc = end;
 	sid_name_ = std::string(sub, trunc - sub);
+	normalise(sid_name_);
 	if (sid_name_ == "DCT") sid_name_.clear();
 
 	next(&fp, &end);
 
 	confirm(end - fp >= 8);
 	destination_ = std::string(fp, 4);
+	normalise(destination_);
 
 	next(&fp, &end);
 
@@ -155,55 +224,4 @@ const char *IcaoFlightPlan::callsign() {
 api::DateTime IcaoFlightPlan::dof_eobt() {
 	return dof_eobt_;
 }
-
-bool IcaoFlightPlan::is_ifr() {
-	return ifr_;
-}
-
-const char *IcaoFlightPlan::departure() {
-	return departure_.c_str();
-}
-
-const char *IcaoFlightPlan::destination() {
-	return destination_.c_str();
-}
-
-int IcaoFlightPlan::cruise_level() {
-	return cruise_level_;
-}
-
-const char *IcaoFlightPlan::route() {
-	return route_.c_str();
-}
-
-std::vector<std::string> IcaoFlightPlan::points() {
-	const char *route = route_.c_str(), *next;
-	std::string point;
-	std::vector<std::string> ret;
-
-	do {
-		next = strchr(route, ' ');
-
-		if (next)
-			point = std::string(route, next - route);
-		else
-			point = std::string(route);
-
-		ret.push_back(std::move(point));
-	} while (next && (route = next + strspn(next, " ")));
-
-	return ret;
-}
-
-const char *IcaoFlightPlan::sid_name() {
-	return sid_name_.c_str();
-}
-
-char IcaoFlightPlan::engine_type() {
-	return aircraft->et;
-}
-
-char IcaoFlightPlan::aircraft_type() {
-	return aircraft->at;
-}
 #endif // ifndef VFPC_STANDALONE
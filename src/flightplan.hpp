@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #ifndef VFPC_STANDALONE
@@ -13,17 +16,46 @@
 #include "source.hpp"
 #endif
 
+// a view of a contiguous sequence, as std::span until C++20
+template<typename T>
+class Span {
+private:
+	T *data_;
+	size_t size_;
+
+public:
+	Span() : data_(nullptr), size_(0) {}
+	Span(T *data, size_t size) : data_(data), size_(size) {}
+
+	template<typename Container>
+	Span(Container &container) : data_(container.data()), size_(container.size()) {}
+
+	T *data() const { return data_; }
+	T *begin() const { return data_; }
+	T *end() const { return data_ + size_; }
+	T &operator[](size_t index) const { return data_[index]; }
+
+	size_t size() const { return size_; }
+	bool empty() const { return !size_; }
+};
+
+// strings are normalised to upper case, owned by the flight plan, and valid
+// until it is destroyed. each is followed by a null terminator, so may also be
+// used as a C string.
 class FlightPlan {
 public:
 	virtual bool is_ifr() = 0;
 
-	virtual const char *departure() = 0;
-	virtual const char *destination() = 0;
+	virtual std::string_view departure() = 0;
+	virtual std::string_view destination() = 0;
 
 	virtual int cruise_level() = 0;
-	virtual const char *route() = 0;
-	virtual std::vector<std::string> points() = 0;
-	virtual const char *sid_name() = 0;
+
+	// the filed route, split into its space-separated tokens
+	virtual Span<const std::string_view> route() = 0;
+	// the names of the points along the route
+	virtual Span<const std::string_view> points() = 0;
+	virtual std::string_view sid_name() = 0;
 
 	virtual char engine_type() = 0;
 	virtual char aircraft_type() = 0;
@@ -37,18 +69,30 @@ private:
 
 	const FlightPlan &fp;
 
+	// normalised copies, made on first use
+	std::pmr::string departure_, destination_, sid_name_, route_buffer_, points_buffer_;
+	std::pmr::vector<std::string_view> route_, points_;
+	bool departure_loaded = false, destination_loaded = false, sid_name_loaded = false;
+	bool route_loaded = false, points_loaded = false;
+
 public:
-	EuroScopeFlightPlan(const FlightPlan &);
+	// the copies are allocated from the given resource, which may be a pool
+	// kept across flight plans
+	EuroScopeFlightPlan(const FlightPlan &, std::pmr::memory_resource * = std::pmr::get_default_resource());
+
+	// the views refer to this object
+	EuroScopeFlightPlan(const EuroScopeFlightPlan &) = delete;
+	EuroScopeFlightPlan &operator=(const EuroScopeFlightPlan &) = delete;
 
 	bool is_ifr() override;
 
-	const char *departure() override;
-	const char *destination() override;
+	std::string_view departure() override;
+	std::string_view destination() override;
 
 	int cruise_level() override;
-	const char *route() override;
-	std::vector<std::string> points() override;
-	const char *sid_name() override;
+	Span<const std::string_view> route() override;
+	Span<const std::string_view> points() override;
+	std::string_view sid_name() override;
 
 	char engine_type() override;
 	char aircraft_type() override;
@@ -56,11 +100,12 @@ public:
 #endif // ifndef VFPC_STANDALONE
 
 #ifdef VFPC_STANDALONE
-class IcaoFlightPlan : public virtual FlightPlan {
+class IcaoFlightPlan final : public virtual FlightPlan {
 private:
 	bool ifr_;
 	int cruise_level_;
-	std::string callsign_, departure_, destination_, route_, sid_name_;
+	std::string callsign_, departure_, destination_, route_buffer_, sid_name_;
+	std::vector<std::string_view> route_;
 	api::DateTime dof_eobt_;
 
 	IcaoAircraft *aircraft;
@@ -68,20 +113,27 @@ private:
 public:
 	IcaoFlightPlan(const char *);
 
+	// the views refer to this object
+	IcaoFlightPlan(const IcaoFlightPlan &) = delete;
+	IcaoFlightPlan &operator=(const IcaoFlightPlan &) = delete;
+
 	const char *callsign();
 	api::DateTime dof_eobt();
 
-	bool is_ifr() override;
+	// defined here to be inlined into checkers over this type
 
-	const char *departure() override;
-	const char *destination() override;
+	bool is_ifr() override { return ifr_; }
 
-	int cruise_level() override;
-	const char *route() override;
-	std::vector<std::string> points() override;
-	const char *sid_name() override;
+	std::string_view departure() override { return departure_; }
+	std::string_view destination() override { return destination_; }
 
-	char engine_type() override;
-	char aircraft_type() override;
+	int cruise_level() override { return cruise_level_; }
+	Span<const std::string_view> route() override { return route_; }
+	// without a route extraction, every token of the route is taken as a point
+	Span<const std::string_view> points() override { return route_; }
+	std::string_view sid_name() override { return sid_name_; }
+
+	char engine_type() override { return aircraft->et; }
+	char aircraft_type() override { return aircraft->at; }
 };
 #endif // ifdef VFPC_STANDALONE
@@ -0,0 +1,164 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <curl/curl.h>
+
+#ifndef VFPC_STANDALONE
+#include <ca-bundle.h>
+#endif
+
+#include <config.h>
+#include "http.hpp"
+
+// how often a stalled transfer checks whether it has been cancelled
+const int POLL_MS = 25;
+
+CurlHttpClient::CurlHttpClient() : user_agent(PLUGIN_NAME "/" PLUGIN_VERSION " ") {
+	const char *curl_ua = curl_version();
+	user_agent.append(curl_ua, strcspn(curl_ua, " "));
+}
+
+static size_t get_write(char *data, size_t size, size_t nmemb, void *user) {
+	size_t n = size * nmemb;
+	((std::string *) user)->append(data, n);
+	return n;
+}
+
+struct StreamState {
+	CURL *curl;
+	const HttpClient::StreamHandler &handler;
+};
+
+static size_t stream_write(char *data, size_t size, size_t nmemb, void *user) {
+	auto state = (StreamState *) user;
+	size_t n = size * nmemb;
+
+	// error bodies are discarded, rather than passed to the handler
+	long code = 0;
+	curl_easy_getinfo(state->curl, CURLINFO_RESPONSE_CODE, &code);
+	if (code < 200 || code >= 300) return n;
+
+	return state->handler(data, n) ? n : 0; // short write aborts
+}
+
+static int xferinfo(void *user, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+	return ((const std::atomic_bool *) user)->load(); // non-zero aborts
+}
+
+static void configure(CURL *curl, const char *url, const char *user_agent, char *error) {
+#ifndef VFPC_STANDALONE
+	// the standalone program uses the system's trust store
+	struct curl_blob ca_info;
+	ca_info.data = (char *) CA_BUNDLE;
+	ca_info.len = strlen((const char *) ca_info.data);
+	ca_info.flags = CURL_BLOB_COPY;
+
+	curl_easy_setopt(curl, CURLOPT_CAINFO_BLOB, &ca_info); // see #2
+	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, (long) 0); // see #1
+#endif
+
+	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, ""); // any supported
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error);
+	curl_easy_setopt(curl, CURLOPT_MAXREDIRS, (long) 1);
+	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, (long) 0);
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent);
+	curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo);
+}
+
+// performs the transfer, returning the response code
+static long perform(CURL *curl, const std::atomic_bool &stop, char *error) {
+	CURLM *multi = curl_multi_init();
+	if (!multi) {
+		curl_easy_cleanup(curl);
+		throw std::string("failed to init libcurl multi");
+	}
+
+	curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &stop);
+
+	// the transfer is driven through a multi handle rather than performed
+	// directly, as libcurl only calls the progress function about once a
+	// second while stalled (e.g. connecting), which would hold up teardown
+
+	curl_multi_add_handle(multi, curl);
+
+	CURLcode ret = CURLE_OK;
+	int running = 1;
+
+	while (running) {
+		CURLMcode mret = curl_multi_perform(multi, &running);
+		if (mret == CURLM_OK && running)
+			mret = curl_multi_poll(multi, nullptr, 0, POLL_MS, nullptr);
+
+		if (mret != CURLM_OK) {
+			ret = CURLE_FAILED_INIT;
+			std::snprintf(error, CURL_ERROR_SIZE, "%s", curl_multi_strerror(mret));
+			break;
+		}
+
+		if (stop.load()) {
+			ret = CURLE_ABORTED_BY_CALLBACK;
+			break;
+		}
+	}
+
+	int queued;
+	while (CURLMsg *msg = curl_multi_info_read(multi, &queued))
+		if (msg->msg == CURLMSG_DONE) ret = msg->data.result;
+
+	long code = 0;
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+
+	curl_multi_remove_handle(multi, curl);
+	curl_multi_cleanup(multi);
+	curl_easy_cleanup(curl);
+
+	if (ret == CURLE_ABORTED_BY_CALLBACK) throw std::string("request cancelled");
+
+	// the handler ending a stream is not an error
+	if (ret == CURLE_WRITE_ERROR && code >= 200 && code < 300) return code;
+
+	if (ret != CURLE_OK) throw std::string(error[0] ? error : curl_easy_strerror(ret));
+
+	return code;
+}
+
+HttpClient::Response CurlHttpClient::get(const char *url, const std::atomic_bool &stop) {
+	if (stop.load()) throw std::string("request cancelled");
+
+	CURL *curl = curl_easy_init();
+	if (!curl) throw std::string("failed to init libcurl easy");
+
+	char error[CURL_ERROR_SIZE] = "";
+	Response response;
+
+	configure(curl, url, user_agent.c_str(), error);
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long) 20);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, get_write);
+
+	response.code = perform(curl, stop, error);
+	return response;
+}
+
+long CurlHttpClient::stream(const char *url, const std::atomic_bool &stop, const StreamHandler &handler) {
+	if (stop.load()) throw std::string("request cancelled");
+
+	CURL *curl = curl_easy_init();
+	if (!curl) throw std::string("failed to init libcurl easy");
+
+	char error[CURL_ERROR_SIZE] = "";
+	StreamState state { curl, handler };
+
+	// streams have no overall timeout, but a silent connection is assumed dead
+	configure(curl, url, user_agent.c_str(), error);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, (long) 20);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, (long) 1);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long) 60);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &state);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, stream_write);
+
+	return perform(curl, stop, error);
+}
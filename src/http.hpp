@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+class HttpClient {
+public:
+	struct Response {
+		long code;
+		std::string body;
+	};
+
+	// receives body data as it arrives; returning false ends the stream
+	using StreamHandler = std::function<bool(const char *, size_t)>;
+
+	virtual ~HttpClient() {}
+
+	// performs a GET request, throwing a std::string if no response is received.
+	// the request is abandoned as soon as possible once stop is set
+	virtual Response get(const char *url, const std::atomic_bool &stop) = 0;
+
+	// performs a long-lived GET request, passing a successful response's body to
+	// the handler until either ends the stream, and returns the response code
+	virtual long stream(const char *url, const std::atomic_bool &stop, const StreamHandler &handler) = 0;
+};
+
+class CurlHttpClient : public virtual HttpClient {
+private:
+	std::string user_agent;
+
+public:
+	CurlHttpClient();
+
+	Response get(const char *url, const std::atomic_bool &stop) override;
+	long stream(const char *url, const std::atomic_bool &stop, const StreamHandler &handler) override;
+};
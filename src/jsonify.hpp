@@ -2,8 +2,13 @@
 
 #include <nlohmann/json.hpp>
 
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -40,6 +45,10 @@ namespace nlohmann {
 	template<typename>   constexpr bool is_vector = false;
 	template<typename T> constexpr bool is_vector<std::vector<T>> = true;
 
+	// lists which are read into a vector of their own, given by fill()
+	template<typename T, typename = void> constexpr bool is_list = false;
+	template<typename T> constexpr bool is_list<T, std::void_t<decltype(std::declval<T &>().fill())>> = true;
+
 	template<typename T>
 	void extended_from_json(const char *key, const nlohmann::json &j, T &value) {
 		const auto it = j.find(key);
@@ -47,18 +56,350 @@ namespace nlohmann {
 			value = it == j.end() ? std::nullopt : T{it->get<typename T::value_type>()};
 		} else if constexpr (is_vector<T>) {
 			value = it == j.end() ? T{} : it->get<T>();
+		} else if constexpr (is_list<T>) {
+			value = T{};
+			if (it != j.end()) it->get_to(value.fill());
 		} else if constexpr (std::is_same_v<T, bool>) {
 			value = it == j.end() ? false : it->get<bool>();
 		} else {
 			j.at(key).get_to(value);
 		}
 	}
+
+	// deserializes directly from parser events, without building a DOM. values
+	// are read through a stack of frames (one per open object or array), each
+	// with a reader for the type being filled. types without a reader of their
+	// own are buffered as a DOM and converted with from_json, so the result is
+	// always the same as that of get<T>().
+	namespace jsonify {
+		struct Reader;
+
+		// a value about to be read
+		struct Slot {
+			const Reader *reader;
+			void *target;
+		};
+
+		// an object or array being read
+		struct Frame {
+			const Reader *reader;
+			void *target;
+			std::unique_ptr<json> buffer;
+			Slot field = { nullptr, nullptr }; // the value of the last key, in objects
+			uint64_t seen = 0; // fields present, by declaration order, in structs
+		};
+
+		struct Reader {
+			void (*scalar)(void *target, json &&value);
+			void (*string)(void *target, std::string &value);
+			Frame (*start)(void *target, bool object);
+			Slot (*key)(Frame &frame, std::string_view key);
+			Slot (*element)(Frame &frame);
+			void (*end)(Frame &frame);
+		};
+
+		template<typename T>
+		constexpr bool is_required = !is_optional<T> && !is_vector<T> && !is_list<T> && !std::is_same_v<T, bool>;
+
+		template<typename T, typename = void>
+		constexpr bool is_struct = false;
+
+		template<typename T>
+		constexpr bool is_struct<T, std::void_t<decltype(sax_check(std::declval<const T &>(), uint64_t()))>> = true;
+
+		template<typename T>
+		const Reader *reader();
+
+		[[noreturn]] inline void missing_key(const char *key) {
+			throw std::string("missing key \"") + key + "\"";
+		}
+
+		inline json &dom(Frame &frame) {
+			return frame.buffer ? *frame.buffer : *(json *) frame.target;
+		}
+
+		// unknown keys are skipped, as get<T>() ignores them
+		inline void skip_scalar(void *, json &&) {}
+		inline void skip_string(void *, std::string &) {}
+		inline Frame skip_start(void *, bool);
+		inline Slot skip_key(Frame &, std::string_view);
+		inline Slot skip_element(Frame &);
+		inline void skip_end(Frame &) {}
+
+		inline constexpr Reader skip_reader = {
+			skip_scalar, skip_string, skip_start, skip_key, skip_element, skip_end,
+		};
+
+		inline Frame skip_start(void *, bool) { return { &skip_reader, nullptr }; }
+		inline Slot skip_key(Frame &, std::string_view) { return { &skip_reader, nullptr }; }
+		inline Slot skip_element(Frame &) { return { &skip_reader, nullptr }; }
+
+		inline Slot skip() {
+			return { &skip_reader, nullptr };
+		}
+
+		// a DOM, for buffering
+		inline void dom_scalar(void *target, json &&value) { *(json *) target = std::move(value); }
+		inline void dom_string(void *target, std::string &value) { *(json *) target = std::move(value); }
+		inline Frame dom_start(void *target, bool object);
+		inline void dom_end(Frame &) {}
+
+		inline Slot dom_key(Frame &frame, std::string_view key);
+
+		inline Slot dom_element(Frame &frame) {
+			json &array = dom(frame);
+			array.push_back(nullptr);
+			return { reader<json>(), &array.back() };
+		}
+
+		inline constexpr Reader dom_reader = {
+			dom_scalar, dom_string, dom_start, dom_key, dom_element, dom_end,
+		};
+
+		inline Frame dom_start(void *target, bool object) {
+			*(json *) target = object ? json::object() : json::array();
+			return { &dom_reader, target };
+		}
+
+		inline Slot dom_key(Frame &frame, std::string_view key) {
+			return { &dom_reader, &dom(frame)[std::string(key)] };
+		}
+
+		// any other type, through from_json
+		template<typename T>
+		void fallback_scalar(void *target, json &&value) {
+			value.get_to(*(T *) target);
+		}
+
+		template<typename T>
+		void fallback_string(void *target, std::string &value) {
+			if constexpr (std::is_same_v<T, std::string>) {
+				*(T *) target = std::move(value);
+			} else {
+				fallback_scalar<T>(target, json(std::move(value)));
+			}
+		}
+
+		template<typename T>
+		void fallback_end(Frame &frame) {
+			frame.buffer->get_to(*(T *) frame.target);
+		}
+
+		template<typename T>
+		Frame fallback_start(void *target, bool object);
+
+		template<typename T>
+		inline constexpr Reader fallback_reader = {
+			fallback_scalar<T>, fallback_string<T>, fallback_start<T>, dom_key, dom_element, fallback_end<T>,
+		};
+
+		template<typename T>
+		Frame fallback_start(void *target, bool object) {
+			return { &fallback_reader<T>, target, std::make_unique<json>(object ? json::object() : json::array()) };
+		}
+
+		// structs with NLOHMANN_JSONIFY_DESERIALIZE_STRUCT
+		template<typename T>
+		Frame struct_start(void *target, bool object) {
+			if (!object) return fallback_start<T>(target, object);
+
+			*(T *) target = T {};
+			return { reader<T>(), target };
+		}
+
+		template<typename T>
+		Slot struct_key(Frame &frame, std::string_view key) {
+			return sax_field(*(T *) frame.target, key, frame.seen);
+		}
+
+		template<typename T>
+		void struct_end(Frame &frame) {
+			sax_check(*(const T *) frame.target, frame.seen);
+		}
+
+		template<typename T>
+		inline constexpr Reader struct_reader = {
+			fallback_scalar<T>, fallback_string<T>, struct_start<T>, struct_key<T>, nullptr, struct_end<T>,
+		};
+
+		// vectors
+		template<typename T>
+		Frame vector_start(void *target, bool object) {
+			if (object) return fallback_start<T>(target, object);
+
+			((T *) target)->clear();
+			return { reader<T>(), target };
+		}
+
+		template<typename T>
+		Slot vector_element(Frame &frame) {
+			auto &element = ((T *) frame.target)->emplace_back();
+			return { reader<typename T::value_type>(), &element };
+		}
+
+		template<typename T>
+		inline constexpr Reader vector_reader = {
+			fallback_scalar<T>, fallback_string<T>, vector_start<T>, nullptr, vector_element<T>, dom_end,
+		};
+
+		// lists, read as their vector
+		template<typename T>
+		using list_vector = std::remove_reference_t<decltype(std::declval<T &>().fill())>;
+
+		template<typename T>
+		void list_scalar(void *target, json &&value) {
+			fallback_scalar<list_vector<T>>(&((T *) target)->fill(), std::move(value));
+		}
+
+		template<typename T>
+		void list_string(void *target, std::string &value) {
+			fallback_string<list_vector<T>>(&((T *) target)->fill(), value);
+		}
+
+		template<typename T>
+		Frame list_start(void *target, bool object) {
+			return reader<list_vector<T>>()->start(&((T *) target)->fill(), object);
+		}
+
+		template<typename T>
+		inline constexpr Reader list_reader = {
+			list_scalar<T>, list_string<T>, list_start<T>, nullptr, nullptr, nullptr,
+		};
+
+		// optionals, which are present if read at all
+		template<typename T>
+		void optional_scalar(void *target, json &&value) {
+			reader<typename T::value_type>()->scalar(&((T *) target)->emplace(), std::move(value));
+		}
+
+		template<typename T>
+		void optional_string(void *target, std::string &value) {
+			reader<typename T::value_type>()->string(&((T *) target)->emplace(), value);
+		}
+
+		template<typename T>
+		Frame optional_start(void *target, bool object) {
+			return reader<typename T::value_type>()->start(&((T *) target)->emplace(), object);
+		}
+
+		template<typename T>
+		inline constexpr Reader optional_reader = {
+			optional_scalar<T>, optional_string<T>, optional_start<T>, nullptr, nullptr, nullptr,
+		};
+
+		template<typename T>
+		const Reader *reader() {
+			if constexpr (std::is_same_v<T, json>) return &dom_reader;
+			else if constexpr (is_optional<T>) return &optional_reader<T>;
+			else if constexpr (is_vector<T> && !std::is_same_v<T, std::vector<bool>>) return &vector_reader<T>;
+			else if constexpr (is_list<T>) return &list_reader<T>;
+			else if constexpr (is_struct<T>) return &struct_reader<T>;
+			else return &fallback_reader<T>;
+		}
+
+		class Handler {
+		private:
+			std::vector<Frame> stack;
+			Slot root;
+
+			Slot next() {
+				if (stack.empty()) return root;
+
+				Frame &top = stack.back();
+				return top.field.reader ? top.field : top.reader->element(top);
+			}
+
+			bool scalar(json &&value) {
+				Slot slot = next();
+				slot.reader->scalar(slot.target, std::move(value));
+				return true;
+			}
+
+			bool start(bool object) {
+				Slot slot = next();
+				stack.push_back(slot.reader->start(slot.target, object));
+				return true;
+			}
+
+			bool end() {
+				Frame &top = stack.back();
+				top.reader->end(top);
+				stack.pop_back();
+				return true;
+			}
+
+		public:
+			Handler(Slot root) : root(root) {}
+
+			bool null() { return scalar(nullptr); }
+			bool boolean(bool value) { return scalar(value); }
+			bool number_integer(json::number_integer_t value) { return scalar(value); }
+			bool number_unsigned(json::number_unsigned_t value) { return scalar(value); }
+			bool number_float(json::number_float_t value, const json::string_t &) { return scalar(value); }
+			bool binary(json::binary_t &value) { return scalar(json::binary(std::move(value))); }
+
+			bool string(json::string_t &value) {
+				Slot slot = next();
+				slot.reader->string(slot.target, value);
+				return true;
+			}
+
+			bool start_object(std::size_t) { return start(true); }
+			bool end_object() { return end(); }
+			bool start_array(std::size_t) { return start(false); }
+			bool end_array() { return end(); }
+
+			bool key(json::string_t &key) {
+				Frame &top = stack.back();
+				top.field = top.reader->key(top, key);
+				return true;
+			}
+
+			bool parse_error(std::size_t, const std::string &, const detail::exception &ex) {
+				throw std::string(ex.what());
+			}
+		};
+
+		// equivalent to json::parse(input).get<T>()
+		template<typename T, typename Input>
+		T parse(Input &&input) {
+			T value {};
+			Handler handler({ reader<T>(), &value });
+
+			json::sax_parse(std::forward<Input>(input), &handler);
+			return value;
+		}
+	}
 }
 
 #define EXTEND_JSON_FROM(v1) extended_from_json(#v1, j, value.v1);
 
-// derives a deserialize implementation, adding defaults for missing values
-#define NLOHMANN_JSONIFY_DESERIALIZE_STRUCT(Type, ...)                       \
-  inline void from_json(const nlohmann::json &j, Type &value) {              \
-	  NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(EXTEND_JSON_FROM, __VA_ARGS__)) \
+#define EXTEND_JSON_SAX_FIELD(v1)                                      \
+  if (key == #v1) {                                                    \
+    seen |= (uint64_t) 1 << index;                                     \
+    return { nlohmann::jsonify::reader<decltype(value.v1)>(), &value.v1 }; \
+  }                                                                    \
+  index++;
+
+#define EXTEND_JSON_SAX_CHECK(v1)                                      \
+  if (nlohmann::jsonify::is_required<decltype(value.v1)>               \
+    && !(seen & (uint64_t) 1 << index)) nlohmann::jsonify::missing_key(#v1); \
+  index++;
+
+// derives a deserialize implementation, adding defaults for missing values,
+// along with the key dispatch and required field check for the SAX reader
+#define NLOHMANN_JSONIFY_DESERIALIZE_STRUCT(Type, ...)                             \
+  inline void from_json(const nlohmann::json &j, Type &value) {                    \
+	  NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(EXTEND_JSON_FROM, __VA_ARGS__))       \
+  }                                                                                \
+                                                                                   \
+  inline nlohmann::jsonify::Slot sax_field(Type &value, std::string_view key, uint64_t &seen) { \
+	  unsigned index = 0;                                                            \
+	  NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(EXTEND_JSON_SAX_FIELD, __VA_ARGS__))  \
+	  return nlohmann::jsonify::skip();                                              \
+  }                                                                                \
+                                                                                   \
+  inline void sax_check(const Type &value, uint64_t seen) {                        \
+	  unsigned index = 0;                                                            \
+	  NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(EXTEND_JSON_SAX_CHECK, __VA_ARGS__))  \
   }
@@ -0,0 +1,407 @@
+#ifndef VFPC_STANDALONE
+#error Cannot compile mirror in default plugin mode!
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+#include "mirror.hpp"
+#include "server.hpp"
+
+using json = nlohmann::json;
+
+// how often the upstream version is checked; without revisions, the cache is
+// instead cleared every CACHE_TTL
+const std::chrono::seconds REVALIDATE_INTERVAL(10), CACHE_TTL(300);
+
+// bodies smaller than this aren't worth compressing
+const size_t COMPRESS_MIN = 256;
+
+static std::string gzip(const std::string &data) {
+	z_stream stream {};
+	if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return {};
+
+	std::string out(deflateBound(&stream, data.length()), '\0');
+
+	stream.next_in = (Bytef *) data.data();
+	stream.avail_in = data.length();
+	stream.next_out = (Bytef *) out.data();
+	stream.avail_out = out.length();
+
+	int ret = deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+
+	return ret == Z_STREAM_END ? out : std::string();
+}
+
+Mirror::Mirror(const char *upstream_url) : upstream_url(upstream_url), stop(false) {
+	if (this->upstream_url.back() != '/') this->upstream_url.push_back('/');
+}
+
+Mirror::EntryPtr Mirror::make_entry(long code, std::string body) {
+	auto entry = std::make_shared<Entry>();
+	entry->code = code;
+	entry->body = std::move(body);
+	entry->fetched = std::chrono::steady_clock::now();
+
+	// compressed once, and served to every client which accepts it
+	if (entry->body.length() >= COMPRESS_MIN) entry->gzipped = gzip(entry->body);
+
+	return entry;
+}
+
+// the cached version's time is moved on by its age, as clients take it for the
+// server's current time
+Mirror::EntryPtr Mirror::restamp(const EntryPtr &version) {
+	if (version->code != 200) return version;
+
+	try {
+		auto body = json::parse(version->body);
+
+		// %H:%M[:%S] or %H%M, as the API sends
+		std::string digits;
+		for (char c : body.at("time").get<std::string>())
+			if (isdigit(c)) digits.push_back(c);
+
+		if (digits.length() != 4 && digits.length() != 6) return version;
+
+		// without seconds, the time is only known to the minute, and stays so
+		bool seconds = digits.length() == 6;
+		if (!seconds) digits.append("00");
+
+		auto age = std::chrono::duration_cast<std::chrono::seconds>(
+			std::chrono::steady_clock::now() - version->fetched
+		);
+
+		long long time = body.at("day").get<long long>() * 86400
+			+ std::stoll(digits.substr(0, 2)) * 3600
+			+ std::stoll(digits.substr(2, 2)) * 60
+			+ std::stoll(digits.substr(4, 2))
+			+ age.count();
+		time %= 7 * 86400;
+
+		char stamp[16];
+		snprintf(stamp, sizeof(stamp), "%02lld:%02lld", time / 3600 % 24, time / 60 % 60);
+		if (seconds) snprintf(stamp + 5, sizeof(stamp) - 5, ":%02lld", time % 60);
+
+		body["time"] = stamp;
+		body["day"] = time / 86400;
+
+		return make_entry(200, body.dump());
+	} catch (...) {
+		return version;
+	}
+}
+
+// only responses for the known API paths are kept, so that arbitrary paths
+// and queries can't grow the cache
+static bool cacheable(const std::string &path) {
+	if (path == "version" || path == "airports" || path == "directory") return true;
+
+	if (path.compare(0, 13, "airport?icao=") || path.length() != 17) return false;
+	return std::all_of(path.begin() + 13, path.end(), [](char c) { return isalnum(c); });
+}
+
+Mirror::EntryPtr Mirror::fetch(const std::string &path) {
+	std::string url = upstream_url + path;
+	spdlog::debug("upstream fetch {}", url);
+
+	auto response = upstream.get(url.c_str(), stop);
+	return make_entry(response.code, std::move(response.body));
+}
+
+Mirror::EntryPtr Mirror::get(const std::string &path) {
+	std::shared_future<EntryPtr> pending;
+	std::promise<EntryPtr> promise;
+	uint64_t initial_generation = 0;
+
+	{
+		std::lock_guard<std::mutex> _lock(lock);
+
+		auto it = cache.find(path);
+		if (it != cache.end()) return std::get<1>(*it);
+
+		// concurrent misses for the same path share one upstream request
+		auto inflight_it = inflight.find(path);
+		if (inflight_it != inflight.end()) {
+			pending = std::get<1>(*inflight_it);
+		} else {
+			inflight.emplace(path, promise.get_future().share());
+			initial_generation = generation;
+		}
+	}
+
+	if (pending.valid()) return pending.get();
+
+	EntryPtr entry;
+
+	try {
+		entry = fetch(path);
+	} catch (...) {
+		{
+			std::lock_guard<std::mutex> _lock(lock);
+			inflight.erase(path);
+		}
+
+		promise.set_exception(std::current_exception());
+		throw;
+	}
+
+	{
+		std::lock_guard<std::mutex> _lock(lock);
+
+		inflight.erase(path);
+
+		// errors are passed on, but not kept
+		bool success = entry->code >= 200 && entry->code < 300;
+		if (success && cacheable(path) && generation == initial_generation) cache.emplace(path, entry);
+	}
+
+	promise.set_value(entry);
+	return entry;
+}
+
+void Mirror::prefetch() {
+	// the whole ruleset is loaded at once if the server allows, and split into
+	// the responses for individual airports
+	EntryPtr airports;
+
+	try {
+		airports = fetch("airports");
+	} catch (...) {
+		return;
+	}
+
+	if (airports->code != 200) return;
+
+	std::map<std::string, EntryPtr> entries;
+
+	try {
+		for (const auto &airport : json::parse(airports->body)) {
+			std::string icao = airport.at("icao").get<std::string>();
+			entries.emplace("airport?icao=" + icao, make_entry(200, json::array({ airport }).dump()));
+		}
+	} catch (...) {
+		spdlog::warn("upstream ruleset is malformed; airports will be fetched individually");
+		return;
+	}
+
+	std::lock_guard<std::mutex> _lock(lock);
+
+	cache.emplace("airports", airports);
+	for (auto &[path, entry] : entries) cache.emplace(path, entry);
+
+	spdlog::info("prefetched {} airports", entries.size());
+}
+
+void Mirror::revalidate() {
+	auto last_clear = std::chrono::steady_clock::now();
+
+	while (true) {
+		std::this_thread::sleep_for(REVALIDATE_INTERVAL);
+
+		EntryPtr version;
+		std::optional<uint64_t> new_revision;
+
+		try {
+			version = fetch("version");
+			if (version->code != 200) continue;
+
+			auto body = json::parse(version->body);
+			if (body.contains("revision")) new_revision = body["revision"].get<uint64_t>();
+		} catch (...) {
+			spdlog::warn("failed to revalidate with upstream; serving cached data");
+			continue;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		bool clear;
+
+		{
+			std::lock_guard<std::mutex> _lock(lock);
+
+			clear = new_revision
+				? new_revision != revision
+				: now - last_clear >= CACHE_TTL;
+
+			if (clear) {
+				spdlog::info("upstream changed; clearing cache");
+
+				cache.clear();
+				generation++;
+				last_clear = now;
+			}
+
+			revision = new_revision;
+			cache.insert_or_assign("version", version);
+		}
+
+		if (clear) {
+			prefetch();
+			revision_cv.notify_all();
+		}
+	}
+}
+
+static const char *reason(long code) {
+	switch (code) {
+		case 200: return "OK";
+		case 400: return "Bad Request";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 502: return "Bad Gateway";
+		default:  return "Unknown";
+	}
+}
+
+void Mirror::serve(int fd) {
+	SocketReader reader(fd);
+	std::string head;
+
+	while (reader.read_until("\r\n\r\n", head)) {
+		std::transform(head.begin(), head.end(), head.begin(), [](char c) {
+			return c == '\r' ? ' ' : c;
+		});
+
+		char method[16] = "", target[1024] = "", version[16] = "";
+		if (sscanf(head.c_str(), "%15s %1023s %15s", method, target, version) != 3) return;
+
+		// only the headers that matter are looked at, case-insensitively
+		std::string lower(head);
+		std::transform(lower.begin(), lower.end(), lower.begin(), tolower);
+
+		bool gzip_ok = false, keep_alive = !strcmp(version, "HTTP/1.1");
+		size_t content_length = 0;
+
+		size_t line_start = lower.find('\n');
+		while (line_start != std::string::npos) {
+			size_t line_end = lower.find('\n', line_start + 1);
+			std::string line = lower.substr(line_start + 1, line_end - line_start - 1);
+			line_start = line_end;
+
+			if (!line.compare(0, 16, "accept-encoding:"))
+				gzip_ok = line.find("gzip") != std::string::npos;
+			else if (!line.compare(0, 11, "connection:"))
+				keep_alive = line.find("close") == std::string::npos &&
+					(keep_alive || line.find("keep-alive") != std::string::npos);
+			else if (!line.compare(0, 15, "content-length:"))
+				content_length = strtoul(line.c_str() + 15, nullptr, 10);
+		}
+
+		if (content_length) {
+			std::string discard;
+			if (!reader.read_exact(content_length, discard)) return;
+		}
+
+		std::string path(target[0] == '/' ? target + 1 : target);
+		EntryPtr entry;
+
+		if (strcmp(method, "GET")) {
+			entry = make_entry(405, "{\"error\":\"method not allowed\"}");
+		} else if (path == "events") {
+			serve_events(fd);
+			return;
+		} else {
+			// normalise the airport so that the cache isn't split by case
+			if (!path.compare(0, 13, "airport?icao="))
+				std::transform(path.begin() + 13, path.end(), path.begin() + 13, toupper);
+
+			try {
+				entry = get(path);
+				if (path == "version") entry = restamp(entry);
+			} catch (...) {
+				entry = make_entry(502, "{\"error\":\"upstream unavailable\"}");
+			}
+		}
+
+		bool compressed = gzip_ok && !entry->gzipped.empty();
+		const std::string &body = compressed ? entry->gzipped : entry->body;
+
+		char header[256];
+		int header_length = snprintf(
+			header, sizeof(header),
+			"HTTP/1.1 %ld %s\r\n"
+			"Content-Type: application/json\r\n"
+			"Content-Length: %zu\r\n"
+			"%s%s\r\n",
+			entry->code, reason(entry->code), body.length(),
+			compressed ? "Content-Encoding: gzip\r\n" : "",
+			keep_alive ? "" : "Connection: close\r\n"
+		);
+
+		if (!write_all(fd, header, header_length)) return;
+		if (!write_all(fd, body.data(), body.length())) return;
+
+		if (!keep_alive) return;
+	}
+}
+
+void Mirror::serve_events(int fd) {
+	const char *header =
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/event-stream\r\n"
+		"Cache-Control: no-cache\r\n"
+		"Connection: close\r\n\r\n";
+
+	if (!write_all(fd, header, strlen(header))) return;
+
+	std::optional<uint64_t> sent;
+
+	// the current revision on connection, then each new revision, with comments
+	// to keep the connection alive
+	while (true) {
+		std::optional<uint64_t> current;
+
+		{
+			std::unique_lock<std::mutex> lock(this->lock);
+			// also while no revision is known, which clients can't be told about
+			if (sent == revision) revision_cv.wait_for(lock, std::chrono::seconds(15));
+			current = revision;
+		}
+
+		std::string event;
+		if (current && current != sent) {
+			event = "event: revision\ndata: {\"revision\":" + std::to_string(*current) + "}\n\n";
+			sent = current;
+		} else {
+			event = ": keep-alive\n\n";
+		}
+
+		if (!write_all(fd, event.data(), event.length())) return;
+	}
+}
+
+void Mirror::run(int port) {
+	auto server = Server::tcp(port, [this](int fd) { serve(fd); });
+
+	prefetch();
+
+	try {
+		auto version = fetch("version");
+		auto body = json::parse(version->body);
+
+		std::lock_guard<std::mutex> _lock(lock);
+		if (body.contains("revision")) revision = body["revision"].get<uint64_t>();
+		cache.insert_or_assign("version", version);
+	} catch (...) {
+		spdlog::warn("upstream unavailable; requests will be retried");
+	}
+
+	std::thread(&Mirror::revalidate, this).detach();
+
+	spdlog::info("mirroring {} on port {}", upstream_url, port);
+	server.run();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef VFPC_STANDALONE
+#error Cannot compile mirror in default plugin mode!
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "http.hpp"
+
+// a caching reverse proxy for the data server, for sharing on a LAN
+class Mirror {
+private:
+	struct Entry {
+		long code;
+		std::string body, gzipped;
+		std::chrono::steady_clock::time_point fetched;
+	};
+
+	using EntryPtr = std::shared_ptr<const Entry>;
+
+	CurlHttpClient upstream;
+	std::string upstream_url;
+	std::atomic_bool stop;
+
+	std::mutex lock;
+	std::condition_variable revision_cv;
+	std::map<std::string, EntryPtr> cache;
+	std::map<std::string, std::shared_future<EntryPtr>> inflight;
+	std::optional<uint64_t> revision;
+	uint64_t generation = 0; // bumped when the cache is cleared
+
+	static EntryPtr make_entry(long code, std::string body);
+	static EntryPtr restamp(const EntryPtr &version);
+
+	EntryPtr get(const std::string &path);
+	EntryPtr fetch(const std::string &path);
+	void revalidate();
+	void prefetch();
+
+	void serve(int fd);
+	void serve_events(int fd);
+
+public:
+	Mirror(const char *upstream_url);
+
+	// serves the API on the port forever
+	[[noreturn]] void run(int port);
+};
@@ -1,5 +1,10 @@
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <exception>
 
 #include <spdlog/spdlog.h>
@@ -21,6 +26,7 @@ const COLORREF TAG_COLOUR_WARN = 0x0079f1;
 const COLORREF TAG_COLOUR_FAIL = 0x0000be;
 
 const int UPDATE_INTERVAL = 30;
+const int UPDATE_INTERVAL_SUBSCRIBED = 300; // changes are pushed; only the time is polled
 
 #define COMMAND_PREFIX ".vfpc"
 
@@ -76,9 +82,12 @@ bool Plugin::OnCompileCommand(const char *command) {
 		display_message("", "Available commands:");
 		display_message("", "  " COMMAND_PREFIX " help          - Display this help text");
 		display_message("", "  " COMMAND_PREFIX " check [CS]... - Check the selected or specified flight plan(s)");
-		display_message("", "  " COMMAND_PREFIX " source [URL]  - Re/set the data server address");
+		display_message("", "  " COMMAND_PREFIX " source [URL]  - Re/set the data server address (and mirrors)");
 		display_message("", "  " COMMAND_PREFIX " source <FILE> - Load airport data from a local file into the cache");
 		display_message("", "  " COMMAND_PREFIX " reload        - Invalidate the airport data and version caches");
+		display_message("", "  " COMMAND_PREFIX " sync <MODE>   - Fetch airports individually (lazy) or all at once (snapshot)");
+		display_message("", "  " COMMAND_PREFIX " limit <MIB>   - Limit memory used by fetched airports (0 for no limit)");
+		display_message("", "  " COMMAND_PREFIX " stats memory  - Display memory used by the airport data");
 		display_message("", "  " COMMAND_PREFIX " debug         - Set the log level to TRACE");
 		display_message("", "See <" PLUGIN_WEB "> for more information.");
 
@@ -94,6 +103,55 @@ bool Plugin::OnCompileCommand(const char *command) {
 		} else if (!strcmp(token, "reload") && !command) {
 			source.invalidate();
 			source.update();
+		} else if (!strcmp(token, "sync") && command) {
+			command = next_token(command, token);
+
+			if (!strcmp(token, "lazy") || !strcmp(token, "snapshot")) {
+				source.set_snapshot(!strcmp(token, "snapshot"));
+				source.invalidate();
+				source.update();
+			} else {
+				display_message("", "Sync mode must be 'lazy' or 'snapshot'", true);
+			}
+		} else if (!strcmp(token, "limit") && command) {
+			command = next_token(command, token);
+
+			// strtoul would accept a sign, and size_t is 32-bit on the plugin's target
+			char *end = token;
+			errno = 0;
+			unsigned long long mib = isdigit((unsigned char) *token) ? strtoull(token, &end, 10) : 0;
+
+			if (end == token || *end || command) {
+				display_message("", "Limit must be a whole number of MiB", true);
+			} else if (errno == ERANGE || mib > SIZE_MAX / (1024 * 1024)) {
+				display_message("", ("Limit must be at most " + std::to_string(SIZE_MAX / (1024 * 1024)) + " MiB").c_str(), true);
+			} else {
+				source.set_memory_limit((size_t) mib * 1024 * 1024);
+			}
+		} else if (!strcmp(token, "stats") && command) {
+			command = next_token(command, token);
+
+			if (!strcmp(token, "memory") && !command) {
+				auto stats = source.memory_stats();
+
+				std::string line = "Airport data: " + std::to_string(stats.airports) + " airports, "
+					+ std::to_string(stats.sids) + " SIDs, " + std::to_string(stats.bytes / 1024) + " KiB";
+				if (stats.limit) line += " (limit " + std::to_string(stats.limit / 1024) + " KiB)";
+				display_message("", line.c_str());
+
+				if (!stats.largest.empty()) {
+					line = "Largest:";
+					for (const auto &[icao, bytes] : stats.largest)
+						line += " " + icao + " " + std::to_string(bytes / 1024) + " KiB";
+					display_message("", line.c_str());
+				}
+
+				line = "Pending " + std::to_string(stats.pending) + ", missing "
+					+ std::to_string(stats.missing) + ", failed " + std::to_string(stats.error);
+				display_message("", line.c_str());
+			} else {
+				display_message("", "Unknown statistics; try '" COMMAND_PREFIX " stats memory'", true);
+			}
 		} else if (!strcmp(token, "check")) {
 			std::string log;
 
@@ -102,24 +160,37 @@ bool Plugin::OnCompileCommand(const char *command) {
 				if (fp.IsValid()) {
 					spdlog::trace("manual check (by selection) for {}", fp.GetCallsign());
 
-					EuroScopeFlightPlan esfp(fp);
-					checker.check(esfp, &log);
+					EuroScopeFlightPlan esfp(fp, &flight_plan_memory);
+					checker.check(esfp, &log, Source::Priority::Explicit);
 					display_message(fp.GetCallsign(), log.c_str(), true);
 				} else {
 					display_message("", "No flight plan selected", true);
 				}
-			} else do {
-				command = next_token(command, token);
-
-				auto fp = FlightPlanSelect(token);
-				if (fp.IsValid()) {
-					spdlog::trace("manual check (by callsign) for {}", fp.GetCallsign());
-
-					EuroScopeFlightPlan esfp(fp);
-					checker.check(esfp, &log);
-					display_message(fp.GetCallsign(), log.c_str(), true);
-				}
-			} while (command);
+			} else {
+				// the flight plans are wrapped in place, as the wrappers refer to them
+				std::deque<EuroScope::CFlightPlan> selected;
+				std::deque<EuroScopeFlightPlan> wrapped;
+				std::vector<FlightPlan *> fps;
+
+				do {
+					command = next_token(command, token);
+
+					auto fp = FlightPlanSelect(token);
+					if (fp.IsValid()) {
+						spdlog::trace("manual check (by callsign) for {}", fp.GetCallsign());
+
+						selected.push_back(fp);
+						wrapped.emplace_back(selected.back(), &flight_plan_memory);
+						fps.push_back(&wrapped.back());
+					}
+				} while (command);
+
+				std::vector<std::string> logs;
+				checker.check_batch(fps, &logs, Source::Priority::Explicit);
+
+				for (size_t i = 0; i < selected.size(); i++)
+					display_message(selected[i].GetCallsign(), logs[i].c_str(), true);
+			}
 		} else {
 			display_message("", "Invalid command; run '" COMMAND_PREFIX " help' for help", true);
 		}
@@ -144,7 +215,7 @@ void Plugin::OnGetTagItem(
 		try {
 			if (!flight_plan.IsValid()) return;
 
-			EuroScopeFlightPlan esfp(flight_plan);
+			EuroScopeFlightPlan esfp(flight_plan, &flight_plan_memory);
 			Result result = checker.check(esfp);
 
 			*item_color = EuroScope::TAG_COLOR_RGB_DEFINED;
@@ -223,8 +294,8 @@ void Plugin::OnFunctionCall(
 				if (fp.IsValid()) {
 					std::string log;
 
-					EuroScopeFlightPlan esfp(fp);
-					checker.check(esfp, &log);
+					EuroScopeFlightPlan esfp(fp, &flight_plan_memory);
+					checker.check(esfp, &log, Source::Priority::Explicit);
 					display_message(fp.GetCallsign(), log.c_str(), true);
 				} else {
 					spdlog::warn("tag function called without ASEL flight plan");
@@ -247,7 +318,9 @@ void Plugin::OnFunctionCall(
 }
 
 void Plugin::OnTimer(int time) {
-	if (last_update < 0 || (time - last_update) > UPDATE_INTERVAL) {
+	int interval = source.is_subscribed() ? UPDATE_INTERVAL_SUBSCRIBED : UPDATE_INTERVAL;
+
+	if (last_update < 0 || (time - last_update) > interval) {
 		source.update();
 		last_update = time;
 	}
@@ -266,6 +339,16 @@ void Plugin::OnTimer(int time) {
 			display_message("", ctx.c_str(), true);
 		}
 	}
+
+	// likewise for messages from background tasks
+	if (messages_lock.try_lock()) {
+		std::vector<std::string> messages_taken;
+		std::swap(messages_taken, messages);
+
+		messages_lock.unlock();
+
+		for (std::string &msg : messages_taken) display_message("", msg.c_str());
+	}
 }
 
 void Plugin::report_exception(const char *ctx) {
@@ -286,3 +369,9 @@ void Plugin::report_exception(const char *ctx) {
 
 	errors.push_back(std::string(ctx ? ctx : ""));
 }
+
+void Plugin::report_message(const char *msg) {
+	std::lock_guard<std::mutex> _lock(messages_lock);
+
+	messages.push_back(std::string(msg));
+}
@@ -5,6 +5,7 @@
 #endif
 
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -23,9 +24,15 @@ private:
 	Checker checker;
 	int last_update = -1;
 
+	// reused by the flight plans wrapped for each check
+	std::pmr::unsynchronized_pool_resource flight_plan_memory;
+
 	inline static std::mutex errors_lock;
 	inline static std::vector<std::string> errors;
 
+	inline static std::mutex messages_lock;
+	inline static std::vector<std::string> messages;
+
 	void display_message(const char *, const char *, bool = false);
 
 public:
@@ -38,4 +45,5 @@ public:
 	void OnTimer(int) override;
 
 	static void report_exception(const char *ctx);
+	static void report_message(const char *msg);
 };
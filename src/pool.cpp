@@ -0,0 +1,118 @@
+#ifndef VFPC_STANDALONE
+#error Cannot compile work pool in default plugin mode!
+#endif
+
+#include <algorithm>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#include "pool.hpp"
+
+WorkPool::WorkPool(unsigned count) {
+	if (!count) count = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned i = 0; i < count; i++)
+		queues.push_back(std::make_unique<Queue>());
+
+	for (unsigned i = 0; i < count; i++)
+		threads.emplace_back(&WorkPool::work, this, i);
+}
+
+WorkPool::~WorkPool() {
+	wait();
+
+	{
+		std::lock_guard guard(lock);
+		stopping = true;
+	}
+
+	work_cv.notify_all();
+	for (auto &thread : threads) thread.join();
+}
+
+size_t WorkPool::size() const {
+	return threads.size();
+}
+
+void WorkPool::submit(Task task) {
+	size_t index;
+
+	{
+		std::lock_guard guard(lock);
+		index = next++ % queues.size();
+	}
+
+	{
+		std::lock_guard guard(queues[index]->lock);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+
+	// counted only once queued, so that a claim always finds a task
+	{
+		std::lock_guard guard(lock);
+		queued++;
+	}
+
+	work_cv.notify_one();
+}
+
+void WorkPool::wait() {
+	std::unique_lock guard(lock);
+	idle_cv.wait(guard, [this]() { return !queued && !running; });
+}
+
+// takes the newest task from the thread's own queue, or else the oldest from
+// another's
+bool WorkPool::take(size_t index, Task &task) {
+	{
+		Queue &own = *queues[index];
+		std::lock_guard guard(own.lock);
+
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < queues.size(); i++) {
+		Queue &other = *queues[(index + i) % queues.size()];
+		std::lock_guard guard(other.lock);
+
+		if (!other.tasks.empty()) {
+			task = std::move(other.tasks.front());
+			other.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkPool::work(size_t index) {
+	while (true) {
+		{
+			std::unique_lock guard(lock);
+			work_cv.wait(guard, [this]() { return queued || stopping; });
+
+			if (!queued) return;
+
+			queued--;
+			running++;
+		}
+
+		// the claim guarantees that a task is queued somewhere
+		Task task;
+		while (!take(index, task)) std::this_thread::yield();
+
+		try {
+			task();
+		} catch (...) {
+			spdlog::warn("caught exception in pool task");
+		}
+
+		std::lock_guard guard(lock);
+		if (!--running && !queued) idle_cv.notify_all();
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef VFPC_STANDALONE
+#error Cannot compile work pool in default plugin mode!
+#endif
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a pool of threads, each taking tasks from its own queue first, and stealing
+// them from the others' when its own is empty
+class WorkPool {
+public:
+	using Task = std::function<void()>;
+
+private:
+	struct Queue {
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+
+	// counts of tasks which are queued but unclaimed, and which are running
+	std::mutex lock;
+	std::condition_variable work_cv, idle_cv;
+	size_t queued = 0, running = 0, next = 0;
+	bool stopping = false;
+
+	bool take(size_t index, Task &task);
+	void work(size_t index);
+
+public:
+	// one thread per core, if no count is given
+	WorkPool(unsigned count = 0);
+	~WorkPool();
+
+	size_t size() const;
+
+	void submit(Task task);
+
+	// waits until every submitted task has finished
+	void wait();
+};
@@ -0,0 +1,176 @@
+#ifndef VFPC_STANDALONE
+#error Cannot compile server in default plugin mode!
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include "server.hpp"
+
+const int BACKLOG = 128;
+
+static std::string error_string(const char *ctx) {
+	std::string message(ctx);
+	message.append(": ");
+	message.append(strerror(errno));
+	return message;
+}
+
+Server Server::tcp(int port, Handler handler) {
+	int fd = socket(AF_INET6, SOCK_STREAM, 0);
+	if (fd < 0) throw error_string("socket");
+
+	int yes = 1, no = 0;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no)); // IPv4 too
+
+	sockaddr_in6 addr {};
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_any;
+	addr.sin6_port = htons(port);
+
+	if (bind(fd, (sockaddr *) &addr, sizeof(addr)) || listen(fd, BACKLOG)) {
+		auto message = error_string("bind");
+		close(fd);
+		throw message;
+	}
+
+	return Server(fd, std::move(handler), true);
+}
+
+Server Server::unix_domain(const char *path, Handler handler) {
+	sockaddr_un addr {};
+	addr.sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) throw std::string("socket path too long");
+	strcpy(addr.sun_path, path);
+
+	// a stale socket from a previous run is replaced, but nothing else is
+	struct stat existing;
+	if (!lstat(path, &existing)) {
+		if (!S_ISSOCK(existing.st_mode)) throw std::string("socket path exists and is not a socket");
+		if (unlink(path)) throw error_string("unlink");
+	} else if (errno != ENOENT) {
+		throw error_string("lstat");
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) throw error_string("socket");
+
+	if (bind(fd, (sockaddr *) &addr, sizeof(addr)) || listen(fd, BACKLOG)) {
+		auto message = error_string("bind");
+		close(fd);
+		throw message;
+	}
+
+	return Server(fd, std::move(handler), false);
+}
+
+Server::Server(int fd, Handler handler, bool tcp) : fd(fd), handler(std::move(handler)), tcp_(tcp) {}
+
+Server::Server(Server &&other) : fd(other.fd), handler(std::move(other.handler)), tcp_(other.tcp_) {
+	other.fd = -1;
+}
+
+Server::~Server() {
+	if (fd >= 0) close(fd);
+}
+
+void Server::run() {
+	while (true) {
+		int client = accept(fd, nullptr, nullptr);
+		if (client < 0) {
+			if (errno != EINTR) spdlog::warn("{}", error_string("accept"));
+			continue;
+		}
+
+		// responses are small and latency matters more than packet count
+		if (tcp_) {
+			int yes = 1;
+			setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+		}
+
+		std::thread([this, client]() {
+			try {
+				handler(client);
+			} catch (const std::exception &ex) {
+				spdlog::warn("caught exception in connection: {}", ex.what());
+			} catch (const std::string &ex) {
+				spdlog::warn("caught exception in connection: {}", ex.c_str());
+			} catch (...) {
+				spdlog::warn("caught exception in connection: (unknown)");
+			}
+
+			close(client);
+		}).detach();
+	}
+}
+
+SocketReader::SocketReader(int fd) : fd(fd) {}
+
+bool SocketReader::read_until(const char *delimiter, std::string &out) {
+	while (true) {
+		size_t found = buffer.find(delimiter, start);
+		if (found != std::string::npos) {
+			out.assign(buffer, start, found - start);
+			start = found + strlen(delimiter);
+			return true;
+		}
+
+		if (start > 0) {
+			buffer.erase(0, start);
+			start = 0;
+		}
+
+		char chunk[4096];
+		ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+
+		buffer.append(chunk, n);
+	}
+}
+
+bool SocketReader::read_exact(size_t n, std::string &out) {
+	while (buffer.length() - start < n) {
+		char chunk[4096];
+		ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) return false;
+
+		buffer.append(chunk, got);
+	}
+
+	out.assign(buffer, start, n);
+	start += n;
+	return true;
+}
+
+bool SocketReader::buffered(const char *delimiter) const {
+	return buffer.find(delimiter, start) != std::string::npos;
+}
+
+bool write_all(int fd, const char *data, size_t n) {
+	while (n) {
+		ssize_t sent = send(fd, data, n, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) continue;
+		if (sent <= 0) return false;
+
+		data += sent;
+		n -= sent;
+	}
+
+	return true;
+}
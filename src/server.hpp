@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef VFPC_STANDALONE
+#error Cannot compile server in default plugin mode!
+#endif
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// a socket server, handling each connection on its own thread
+class Server {
+public:
+	// handles one connection, returning when it should be closed
+	using Handler = std::function<void(int)>;
+
+private:
+	int fd;
+	Handler handler;
+	bool tcp_;
+
+public:
+	// listens on a TCP port on all interfaces, or on a Unix domain socket
+	static Server tcp(int port, Handler handler);
+	static Server unix_domain(const char *path, Handler handler);
+
+	Server(int fd, Handler handler, bool tcp);
+	Server(Server &&);
+	~Server();
+
+	// accepts connections forever
+	[[noreturn]] void run();
+};
+
+// buffered reading of delimited messages from a socket
+class SocketReader {
+private:
+	int fd;
+	std::string buffer;
+	size_t start = 0;
+
+public:
+	SocketReader(int fd);
+
+	// reads up to and excluding the delimiter, returning false on end of stream
+	bool read_until(const char *delimiter, std::string &out);
+
+	// reads exactly n bytes, returning false on end of stream
+	bool read_exact(size_t n, std::string &out);
+
+	// whether a whole message is already buffered, to be read without blocking
+	bool buffered(const char *delimiter) const;
+};
+
+// writes all of the data, returning false if the connection is broken
+bool write_all(int fd, const char *data, size_t n);
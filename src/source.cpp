@@ -1,22 +1,35 @@
+#include <algorithm>
 #include <cstring>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
-#include <fstream>
+#include <exception>
+#include <future>
+#include <limits>
+#include <list>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <optional>
+#include <random>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
-#ifndef VFPC_STANDALONE
-#include <curl/curl.h>
-#endif
-
-#include <ca-bundle.h>
 #include <config.h>
+#include "http.hpp"
 #include "jsonify.hpp"
 #include "source.hpp"
 
@@ -26,6 +39,38 @@
 
 #define DEFAULT_SOURCE "https://vfpc.tomjmills.co.uk/"
 
+// airports are fetched by a fixed pool of workers, highest priority first
+const int FETCH_WORKERS = 4;
+
+// airport data is refreshed in the background once it is this old, plus up to
+// a tenth more at random
+const std::chrono::minutes AIRPORT_TTL(30);
+
+// airports used within this long aren't evicted, even past the memory limit, so
+// that a working set larger than the limit isn't evicted and fetched in a loop
+const std::chrono::seconds EVICT_IDLE_MIN(60);
+
+// past this many airports known to have no data, the oldest are forgotten
+const size_t MISSING_MAX = 4096;
+
+// rulesets are loaded in parallel in chunks of at least this many airports
+const size_t LOAD_CHUNK_MIN = 32;
+
+// failed fetches are retried after an exponential backoff with full jitter
+const std::chrono::seconds RETRY_BASE(5), RETRY_MAX(600);
+
+// endpoint response times are smoothed for ranking, and the most recent are
+// kept for the hedging deadline (their 95th percentile)
+const double ENDPOINT_SMOOTHING = 0.2;
+const size_t ENDPOINT_SAMPLES = 64;
+const double FAILURE_PENALTY_MS = 20000.0;
+
+const std::chrono::milliseconds HEDGE_DEFAULT(1000), HEDGE_MIN(20), HEDGE_POLL(5);
+
+// the API clock counts milliseconds into the week, starting at day 0
+const int64_t CLOCK_WEEK = 7 * 24 * 3600 * 1000;
+const int64_t CLOCK_UNKNOWN = std::numeric_limits<int64_t>::min();
+
 using json = nlohmann::json;
 
 namespace api {
@@ -45,6 +90,12 @@ namespace api {
 
 		time.hour = strtol(hour, nullptr, 10);
 		time.minute = strtol(minute, nullptr, 10);
+
+		str += 2;
+		if (*str != ':' || strlen(str) < 3) return;
+		char second[3] = { str[1], str[2], 0 };
+
+		time.second = strtol(second, nullptr, 10);
 	}
 
 	NLOHMANN_JSON_SERIALIZE_ENUM(Direction, {
@@ -61,15 +112,26 @@ namespace api {
 		std::string api_version;
 		Time time;
 		uint8_t day;
+		std::optional<uint64_t> revision;
+	};
+
+	NLOHMANN_JSONIFY_DESERIALIZE_STRUCT(Version, api_version, time, day, revision);
+
+	// airports which have changed between two ruleset revisions; "reset" is set
+	// when the server cannot tell (e.g. the old revision is too old)
+	struct Changes {
+		uint64_t revision;
+		bool reset;
+		std::vector<std::string> changed, removed;
 	};
 
-	NLOHMANN_JSONIFY_DESERIALIZE_STRUCT(Version, api_version, time, day);
+	NLOHMANN_JSONIFY_DESERIALIZE_STRUCT(Changes, revision, reset, changed, removed);
 
 	struct SidRaw {
 		std::string point;
 		std::vector<std::string> aliases;
 		std::vector<Constraint> constraints;
-		std::vector<Restriction> restrictions;
+		SharedList<Restriction> restrictions;
 	};
 
 	NLOHMANN_JSONIFY_DESERIALIZE_STRUCT(SidRaw, point, aliases, constraints, restrictions);
@@ -82,17 +144,223 @@ namespace api {
 	NLOHMANN_JSONIFY_DESERIALIZE_STRUCT(Airport, icao, sids);
 }
 
-static json fetch(const char *url);
 static void load(
 	std::vector<api::Airport> &airports,
-	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &sids
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &sids,
+	ConstraintPool &pool
+);
+
+static void load(
+	std::string_view data,
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &sids,
+	ConstraintPool &pool
+);
+
+static void merge(
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &from,
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &into
+);
+
+static bool reuse_unchanged(
+	std::map<std::string, std::shared_ptr<api::Sid>> &fresh,
+	const std::map<std::string, std::shared_ptr<api::Sid>> &old
 );
 
+static size_t footprint(const std::string &icao, const std::map<std::string, std::shared_ptr<api::Sid>> &sid_map);
+
+// weak entries for structurally equal values, by hash, so that values are still
+// freed once nothing else uses them
+template<typename T>
+class InternTable {
+private:
+	std::mutex lock;
+	std::unordered_map<size_t, std::vector<std::weak_ptr<const T>>> buckets;
+	size_t sweep_at = 1024;
+
+public:
+	std::shared_ptr<const T> intern(std::shared_ptr<const T> value, size_t hash);
+
+	// removes the entries of freed values, which are otherwise only removed
+	// when their bucket is next used
+	void sweep();
+};
+
+// shares structurally identical constraints, restriction lists and string
+// lists between SIDs and airports, which are common in the UK data
+class ConstraintPool {
+private:
+	InternTable<api::Constraint> constraints;
+	InternTable<std::vector<api::Restriction>> restriction_lists;
+	InternTable<std::vector<std::string>> string_lists;
+
+public:
+	api::SharedList<std::string> intern(const api::SharedList<std::string> &list);
+	api::SharedList<api::Restriction> intern(const api::SharedList<api::Restriction> &list);
+
+	// interns the lists of the constraint, then the constraint itself
+	std::shared_ptr<const api::Constraint> intern(api::Constraint &&constraint);
+
+	void sweep();
+};
+
+// a read-only view of a whole file, which is mapped rather than read so that
+// it can be parsed in place
+class MappedFile {
+private:
+	const char *data = nullptr;
+	size_t length = 0;
+
+public:
+	MappedFile(const char *path);
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	std::string_view view() const {
+		return std::string_view(data ? data : "", length);
+	}
+};
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const char *path) {
+	HANDLE file = CreateFileA(
+		path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+	);
+
+	if (file == INVALID_HANDLE_VALUE) throw std::string("failed to open ") + path;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		throw std::string("failed to stat ") + path;
+	}
+
+	length = (size_t) size.QuadPart;
+
+	// empty files can't be mapped
+	if (length) {
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping) {
+			data = (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+	}
+
+	// the view keeps the file open
+	CloseHandle(file);
+
+	if (length && !data) throw std::string("failed to map ") + path;
+}
+
+MappedFile::~MappedFile() {
+	if (data) UnmapViewOfFile(data);
+}
+
+#else
+
+MappedFile::MappedFile(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) throw std::string("failed to open ") + path;
+
+	struct stat info;
+	if (fstat(fd, &info) < 0) {
+		close(fd);
+		throw std::string("failed to stat ") + path;
+	}
+
+	length = (size_t) info.st_size;
+
+	// empty files can't be mapped
+	if (length) {
+		void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (mapped != MAP_FAILED) {
+			madvise(mapped, length, MADV_SEQUENTIAL);
+			data = (const char *) mapped;
+		}
+	}
+
+	// the mapping keeps the file open
+	close(fd);
+
+	if (length && !data) throw std::string("failed to map ") + path;
+}
+
+MappedFile::~MappedFile() {
+	if (data) munmap((void *) data, length);
+}
+
+#endif
+
+
+static void report_exception(const char *ctx) {
+#ifndef VFPC_STANDALONE
+	Plugin::report_exception(ctx);
+#else
+	try {
+		throw;
+	} catch (const std::exception &ex) {
+		spdlog::warn("caught exception in {}: {}", ctx, ex.what());
+	} catch (const std::string &ex) {
+		spdlog::warn("caught exception in {}: {}", ctx, ex.c_str());
+	} catch (int code) {
+		spdlog::warn("caught exception in {}: server returned code {}", ctx, code);
+	} catch (...) {
+		spdlog::warn("caught exception in {}: (unknown)", ctx);
+	}
+#endif
+}
+
+static void report_message(const char *msg) {
 #ifndef VFPC_STANDALONE
-PluginSource::PluginSource() :
-	web_source(DEFAULT_SOURCE),
-	cache_version(0)
+	Plugin::report_message(msg);
+#else
+	spdlog::info("{}", msg);
+#endif
+}
+
+// a uniformly random duration of up to the limit
+static std::chrono::seconds jitter(std::chrono::seconds limit) {
+	static thread_local std::minstd_rand rng(std::random_device{}());
+
+	std::uniform_int_distribution<long long> distribution(0, limit.count());
+	return std::chrono::seconds(distribution(rng));
+}
+
+static std::chrono::seconds backoff(unsigned failures) {
+	auto limit = RETRY_BASE * (1 << std::min(failures, 16u));
+	if (limit > RETRY_MAX) limit = RETRY_MAX;
+
+	return jitter(limit);
+}
+
+// the response is deserialized as it is parsed, without an intermediate DOM
+template<typename T>
+T PluginSource::fetch(const std::string &path) {
+	return nlohmann::jsonify::parse<T>(fetch_body(path));
+}
+
+PluginSource::PluginSource(std::unique_ptr<HttpClient> http) :
+	http(std::move(http)),
+	constraint_pool(std::make_unique<ConstraintPool>()),
+	clock_offset(CLOCK_UNKNOWN),
+	cache_version(0),
+	snapshot_mode(false),
+	snapshot_loading(false),
+	subscribed(false),
+	stopping(false),
+	resubscribe(false)
 {
+	set(nullptr);
+
+	for (int i = 0; i < FETCH_WORKERS; i++)
+		workers.emplace_back(&PluginSource::fetch_worker, this);
+
+	subscriber = std::thread(&PluginSource::subscribe, this);
+
 	update();
 }
 
@@ -100,6 +368,21 @@ PluginSource::~PluginSource() {
 	// should cause any subsequently-finishing threads to fail
 	cache_version++;
 
+	// cancels every in-flight transfer, so none of the below waits for long
+	{
+		std::lock_guard<std::mutex> _lock(queue_lock);
+
+		stopping = true;
+		resubscribe = true;
+		for (auto &queue : queues) queue.clear();
+	}
+
+	queue_cv.notify_all();
+	stop_cv.notify_all();
+
+	for (auto &worker : workers) worker.join();
+	subscriber.join();
+
 	spdlog::trace("acquiring source locks");
 
 	this_lock.lock();
@@ -110,35 +393,137 @@ PluginSource::~PluginSource() {
 }
 
 void PluginSource::set(const char *source) {
-	if (!source) {
-		spdlog::trace("resetting source");
+	if (!source || strstr(source, "://")) {
+		spdlog::trace(source ? "setting new web sources" : "resetting source");
+
+		std::vector<std::shared_ptr<Endpoint>> new_endpoints;
+
+		const char *cursor = source ? source : DEFAULT_SOURCE;
+		while (*(cursor += strspn(cursor, " "))) {
+			std::string url(cursor, strcspn(cursor, " "));
+			cursor += url.length();
 
-		web_source = DEFAULT_SOURCE;
-	} else if (strstr(source, "://")) {
-		spdlog::trace("setting new web source");
+			if (url.back() != '/') url.push_back('/');
+			new_endpoints.push_back(std::make_shared<Endpoint>(std::move(url)));
+		}
+
+		{
+			std::lock_guard<std::mutex> _lock(endpoints_lock);
+			endpoints.swap(new_endpoints);
+		}
+
+		// reconnect to the new endpoints
+		{
+			std::lock_guard<std::mutex> _lock(queue_lock);
+			resubscribe = true;
+		}
 
-		web_source = source;
-		if (web_source.back() != '/') web_source.push_back('/');
+		stop_cv.notify_all();
 	} else {
 		spdlog::trace("loading file source");
 
-		std::ifstream fd(source);
-		std::vector<api::Airport> data = json::parse(fd);
+		// large files take a while to parse, so are loaded in the background and
+		// merged into the cache when complete
+		std::promise<void> promise;
+		std::future<void> future = promise.get_future();
 
-		std::lock_guard<std::mutex> _lock(cache_lock);
-		load(data, sids);
+		std::thread t(&PluginSource::load_file, this, std::string(source), std::move(promise));
+		t.detach();
+
+		future.wait();
+	}
+}
+
+void PluginSource::load_file(std::string path, std::promise<void> promise) {
+	std::shared_lock<std::shared_mutex> _lock(this_lock);
+	promise.set_value();
+
+	auto initial_cache_version = cache_version.load();
+	auto start = Clock::now();
+
+	report_message(("Loading airport data from " + path).c_str());
+
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> loaded;
+
+	try {
+		MappedFile file(path.c_str());
+		load(file.view(), loaded, *constraint_pool);
+		constraint_pool->sweep();
+	} catch (...) {
+		if (!stopping.load()) report_exception("file load");
+		return;
+	}
+
+	if (stopping.load()) return;
+
+	size_t count = loaded.size();
+
+	{
+		std::lock_guard<std::mutex> _lock2(cache_lock);
+
+		// a reload after the file was requested discards it, as it would have done
+		// had the file loaded immediately. this is checked under the lock, as the
+		// cache is cleared under it after the version is bumped
+		if (initial_cache_version != cache_version.load()) {
+			spdlog::trace("discarding file due to cache invalidation");
+			return;
+		}
+
+		for (const auto &[icao, _sid_map] : loaded) {
+			meta.erase(icao);
+			missing.erase(icao);
+			error.erase(icao);
+		}
+
+		prune_missing_order();
+
+		publish(loaded, false);
 	}
+
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+	report_message((
+		"Loaded " + std::to_string(count) + " airports from " + path
+		+ " in " + std::to_string(ms) + " ms"
+	).c_str());
 }
 
 void PluginSource::invalidate() {
 	cache_version++;
 
+	{
+		std::lock_guard<std::mutex> _lock(queue_lock);
+		for (auto &queue : queues) queue.clear();
+	}
+
 	std::lock_guard<std::mutex> _lock(cache_lock);
 
 	pending.clear();
 	missing.clear();
+	missing_order.clear();
 	error.clear();
+	meta.clear();
 	sids.clear();
+
+	invalidated_generation = ++generation_counter;
+	generations.clear();
+
+	usage.clear();
+	lru.clear();
+	memory_used = 0;
+
+	snapshot_loaded = false;
+	directory_loaded = false;
+	directory.clear();
+
+	std::lock_guard<std::mutex> _lock2(update_lock);
+	snapshot_revision.reset();
+	directory_revision.reset();
+}
+
+void PluginSource::set_snapshot(bool snapshot) {
+	spdlog::trace("setting sync mode to {}", snapshot ? "snapshot" : "lazy");
+
+	snapshot_mode = snapshot;
 }
 
 void PluginSource::update() {
@@ -154,9 +539,6 @@ void PluginSource::update() {
 }
 
 void PluginSource::fetch_update(std::promise<void> promise) {
-	std::string url = web_source; // copy
-	url.append("version");
-
 	std::shared_lock<std::shared_mutex> _lock(this_lock);
 
 	// we have to take the lock on our worker thread, but we shouldn't allow the
@@ -168,222 +550,1416 @@ void PluginSource::fetch_update(std::promise<void> promise) {
 	spdlog::trace("updating");
 
 	api::Version version;
+	auto sent = Clock::now();
+
 	try {
-		version = fetch(url.c_str());
+		version = fetch<api::Version>("version");
 	} catch (...) {
-		Plugin::report_exception("update call");
+		if (!stopping.load()) report_exception("update call");
 		return;
 	}
 
-	std::lock_guard<std::mutex> _lock2(update_lock);
-
-	datetime_value.date = version.day;
-	datetime_value.time = version.time;
+	correct_clock(version, sent, Clock::now());
+	sync(version.revision);
 
 	spdlog::trace("update complete");
 }
 
-api::DateTime PluginSource::datetime() {
-	std::lock_guard<std::mutex> _lock(update_lock);
-	return datetime_value;
+static int64_t local_ms(std::chrono::steady_clock::time_point time) {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
 }
 
-Source::CacheStatus PluginSource::airport(const char *icao) {
-	std::lock_guard<std::mutex> _lock(cache_lock);
-
-	if (  error.find(icao) !=   error.end()) return Source::CacheStatus::Error;
-	if (missing.find(icao) != missing.end()) return Source::CacheStatus::Missing;
-	if (pending.find(icao) != pending.end()) return Source::CacheStatus::Pending;
-	if (   sids.find(icao) !=    sids.end()) return Source::CacheStatus::Extant;
+void PluginSource::correct_clock(const api::Version &version, Clock::time_point sent, Clock::time_point received) {
+	// the server's time is truncated to its precision, and was taken at some
+	// point during the request, so the true time on receipt lies in a window.
+	// the model is only moved when it falls outside the window, so repeated
+	// observations narrow the error to well below the precision.
 
-	// TODO: we could batch these requests, and have fetch_airport wait and then
-	// fetch all in pending
+	int64_t precision = version.time.second ? 1000 : 60000;
+	int64_t observed = (int64_t) version.day * 86400000
+		+ (int64_t) version.time.hour * 3600000
+		+ (int64_t) version.time.minute * 60000
+		+ (int64_t) version.time.second.value_or(0) * 1000;
 
-	pending.insert(std::string(icao));
+	int64_t window = precision + local_ms(received) - local_ms(sent);
+	int64_t offset = clock_offset.load();
 
-	std::promise<void> promise;
-	std::future<void> future = promise.get_future();
+	if (offset == CLOCK_UNKNOWN) {
+		clock_offset = observed + window / 2 - local_ms(received);
+		return;
+	}
 
-	std::thread t(&PluginSource::fetch_airport, this, std::move(promise), icao);
-	t.detach();
+	// how far the model is ahead of the start of the window, wrapped to within
+	// half a week either way
+	int64_t ahead = ((local_ms(received) + offset - observed) % CLOCK_WEEK + CLOCK_WEEK) % CLOCK_WEEK;
+	if (ahead > CLOCK_WEEK / 2) ahead -= CLOCK_WEEK;
 
-	future.wait();
+	if (ahead < 0) {
+		offset -= ahead;
+	} else if (ahead > window) {
+		offset -= ahead - window;
+	} else {
+		return;
+	}
 
-	return Source::CacheStatus::Pending;
+	spdlog::debug("corrected clock by {} ms", ahead < 0 ? -ahead : window - ahead);
+	clock_offset = offset;
 }
 
-void PluginSource::fetch_airport(std::promise<void> promise, const char *c_icao) {
-	spdlog::trace("requesting airport {}", c_icao);
+void PluginSource::sync(std::optional<uint64_t> new_revision) {
+	// updates and pushed notifications may arrive together
+	std::lock_guard<std::mutex> _lock(sync_lock);
 
-	std::string url = web_source, icao = c_icao; // copy
-	url.append("airport?icao=");
-	url.append(c_icao); // URL-encoding shouldn't be an issue
+	std::optional<uint64_t> known_revision;
 
-	auto initial_cache_version = cache_version.load();
+	{
+		std::lock_guard<std::mutex> _lock2(update_lock);
 
-	std::shared_lock<std::shared_mutex> _lock(this_lock);
+		known_revision = revision;
+		if (!known_revision) revision = new_revision;
+	}
 
-	// see PluginSource::fetch_update
-	promise.set_value();
+	// servers without revisions only have their directory and snapshot fetched
+	// on startup and reload
+	uint64_t current_revision = new_revision.value_or(0);
 
-	std::vector<api::Airport> airports;
-	try {
-		airports = fetch(url.c_str());
-	} catch (...) {
-		std::lock_guard<std::mutex> _lock2(cache_lock);
+	std::optional<uint64_t> loaded_directory_revision;
 
-		pending.erase(icao);
+	{
+		std::lock_guard<std::mutex> _lock2(update_lock);
+		loaded_directory_revision = directory_revision;
+	}
+
+	if (loaded_directory_revision != current_revision)
+		fetch_directory(current_revision);
+
+	if (snapshot_mode.load()) {
+		std::optional<uint64_t> loaded_revision;
+
+		{
+			std::lock_guard<std::mutex> _lock2(update_lock);
+
+			loaded_revision = snapshot_revision;
+			revision = new_revision;
+		}
+
+		if (loaded_revision != current_revision && !snapshot_loading.exchange(true)) {
+			fetch_snapshot(current_revision);
+			snapshot_loading = false;
+		}
+	} else if (known_revision && new_revision && *known_revision != *new_revision) {
+		// servers without revisions, and the first update, have nothing to sync
+
+		spdlog::trace("revision changed from {} to {}", *known_revision, *new_revision);
+
+		api::Changes changes;
 
 		try {
-			throw;
-		} catch (int code) {
-			// server returns 400 for non EG**, and 404 for unknown EG**
-			if (code == 400 || code == 404) {
-				missing.insert(icao);
-				return;
-			}
-		} catch (...) {}
+			changes = fetch<api::Changes>("changes?since=" + std::to_string(*known_revision));
+		} catch (...) {
+			if (stopping.load()) return;
 
-		Plugin::report_exception("airport request call");
+			// expiring everything is always correct, if wasteful
+			spdlog::warn("failed to fetch ruleset changes; refreshing all airports");
 
-		error.insert(icao);
+			changes.revision = *new_revision;
+			changes.reset = true;
+		}
 
-		return;
-	}
+		apply_changes(changes);
 
-	if (initial_cache_version != cache_version.load()) {
-		spdlog::trace("discarding fetch result due to cache invalidation");
-		return;
+		std::lock_guard<std::mutex> _lock2(update_lock);
+		revision = changes.revision;
 	}
+}
 
-	std::lock_guard<std::mutex> _lock2(cache_lock);
+void PluginSource::subscribe() {
+	unsigned failures = 0;
 
-	load(airports, sids);
-	pending.erase(icao);
+	while (!stopping.load()) {
+		resubscribe = false;
 
-	spdlog::trace("airport request complete");
-}
+		std::shared_ptr<Endpoint> endpoint;
 
-std::shared_ptr<const api::Sid> PluginSource::sid(const char *icao, const char *point) {
-	std::lock_guard<std::mutex> _lock(cache_lock);
+		{
+			std::lock_guard<std::mutex> _lock(endpoints_lock);
 
-	auto airport_it = sids.find(icao);
-	if (airport_it == sids.end()) return nullptr;
+			// pick the fastest endpoint, as for any other request
+			for (auto &candidate : endpoints)
+				if (!endpoint || candidate->rank() < endpoint->rank()) endpoint = candidate;
+		}
 
-	auto &airport = std::get<1>(*airport_it);
-	auto sid_it = airport.find(point);
-	if (sid_it == airport.end()) return nullptr;
+		if (endpoint) {
+			std::string url = endpoint->url + "events", buffer, data;
+
+			spdlog::trace("subscribing to {}", url);
+
+			// server-sent events: "field: value" lines, dispatched on a blank line.
+			// only the data field is used, which should contain the revision
+			auto handler = [this, &failures, &buffer, &data](const char *chunk, size_t n) {
+				buffer.append(chunk, n);
+
+				size_t start = 0, end;
+				while ((end = buffer.find('\n', start)) != std::string::npos) {
+					std::string line = buffer.substr(start, end - start);
+					start = end + 1;
+
+					if (!line.empty() && line.back() == '\r') line.pop_back();
+
+					if (line.empty() && !data.empty()) {
+						try {
+							auto event = json::parse(data);
+
+							// only a revision shows that changes will be notified; a stream
+							// of keep-alives alone doesn't
+							if (event.contains("revision")) {
+								sync(event["revision"].get<uint64_t>());
+
+								if (!subscribed.exchange(true)) spdlog::info("subscribed to change notifications");
+								failures = 0;
+							}
+						} catch (...) {
+							report_exception("change notification");
+						}
+
+						data.clear();
+					} else if (!line.compare(0, 5, "data:")) {
+						data.append(line, line[5] == ' ' ? 6 : 5);
+					}
+				}
+
+				buffer.erase(0, start);
+				return !stopping.load();
+			};
+
+			try {
+				long code = http->stream(url.c_str(), resubscribe, handler);
+
+				// servers without notifications are polled instead
+				if (code < 200 || code >= 300) {
+					spdlog::trace("change notifications unavailable ({})", code);
+					failures++;
+				}
+			} catch (...) {
+				if (stopping.load()) break;
+
+				if (!resubscribe.load()) {
+					spdlog::trace("change notification stream failed");
+					failures++;
+				}
+			}
 
-	return std::get<1>(*sid_it);
-}
+			if (subscribed.exchange(false)) spdlog::info("change notifications lost; polling");
+		}
 
-static char *user_agent = nullptr;
-static char user_agent_buffer[64] = PLUGIN_NAME "/" PLUGIN_VERSION " ";
+		std::unique_lock<std::mutex> lock(queue_lock);
+		stop_cv.wait_for(lock, backoff(failures), [this]() { return resubscribe.load(); });
+	}
+}
 
-static size_t fetch_write(char *data, size_t size, size_t nmemb, void *user) {
-	size_t n = size * nmemb;
-	((std::string *) user)->append(data, n);
-	return n;
+bool PluginSource::is_subscribed() {
+	return subscribed.load();
 }
 
-static json fetch(const char *url) {
-	spdlog::trace("fetch {}", url);
+// packs an ICAO code such that ordering is preserved, if it is valid
+static std::optional<uint32_t> pack_icao(const char *icao) {
+	uint32_t packed = 0;
 
-	CURL *curl = curl_easy_init();
-	if (!curl) throw std::string("failed to init libcurl easy");
+	for (int i = 0; i < 4; i++) {
+		if (icao[i] < 'A' || icao[i] > 'Z') return std::nullopt;
+		packed = (packed << 8) | (uint8_t) icao[i];
+	}
 
-	if (!user_agent) {
-		const char *curl_ua = curl_version();
-		strncat(user_agent_buffer, curl_ua, strcspn(curl_ua, " "));
+	if (icao[4]) return std::nullopt;
 
-		user_agent = user_agent_buffer;
-	}
+	return packed;
+}
 
-	char error[CURL_ERROR_SIZE];
-	std::string buffer; // TODO: stream into the JSON parser instead?
+void PluginSource::fetch_directory(uint64_t directory_rev) {
+	spdlog::trace("fetching directory for revision {}", directory_rev);
 
-	struct curl_blob ca_info;
-	ca_info.data = (char *) CA_BUNDLE;
-	ca_info.len = strlen((const char *) ca_info.data);
-	ca_info.flags = CURL_BLOB_COPY;
+	auto initial_cache_version = cache_version.load();
 
-	curl_easy_setopt(curl, CURLOPT_CAINFO_BLOB, &ca_info); // see #2
-	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, (long) 0); // see #1
-	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error);
-	curl_easy_setopt(curl, CURLOPT_MAXREDIRS, (long) 1);
-	curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long) 20);
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, fetch_write);
+	std::vector<uint32_t> packed;
 
-	CURLcode ret = curl_easy_perform(curl);
+	try {
+		auto icaos = fetch<std::vector<std::string>>("directory");
 
-	long code;
-	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		packed.reserve(icaos.size());
+		for (const auto &icao : icaos)
+			if (auto icao_packed = pack_icao(icao.c_str())) packed.push_back(*icao_packed);
 
-	curl_easy_cleanup(curl);
+		std::sort(packed.begin(), packed.end());
+	} catch (...) {
+		if (stopping.load()) return;
 
-	if (ret != CURLE_OK) throw std::string(error);
-	if (code < 200 || code >= 300) {
-		/* std::snprintf(error, CURL_ERROR_SIZE, "server returned code %ld", code);
-		throw std::string(error); */
+		// the directory is only an optimisation, and may not be supported. don't
+		// try again until the next revision
+		spdlog::warn("failed to fetch airport directory; airports will be queried individually");
 
-		throw (int) code;
-	}
+		{
+			std::lock_guard<std::mutex> _lock(cache_lock);
+			directory_loaded = false;
+		}
 
-	json out = json::parse(buffer);
-	return out;
-}
-#endif // ifndef VFPC_STANDALONE
+		std::lock_guard<std::mutex> _lock(update_lock);
+		directory_revision = directory_rev;
 
-StaticSource::StaticSource(json &data, api::DateTime datetime) :
-	datetime_value(datetime)
-{
-	auto airports = data.template get<std::vector<api::Airport>>();
-	load(airports, sids);
-}
+		return;
+	}
 
-api::DateTime StaticSource::datetime() {
-	return datetime_value;
-}
+	if (initial_cache_version != cache_version.load()) {
+		spdlog::trace("discarding directory due to cache invalidation");
+		return;
+	}
 
-Source::CacheStatus StaticSource::airport(const char *icao) {
-	return sids.find(icao) == sids.end()
-		? Source::CacheStatus::Missing
-		: Source::CacheStatus::Extant;
-}
+	{
+		std::lock_guard<std::mutex> _lock(cache_lock);
 
-std::shared_ptr<const api::Sid> StaticSource::sid(const char *icao, const char *point) {
-	auto airport_it = sids.find(icao);
-	if (airport_it == sids.end()) return nullptr;
+		directory.swap(packed);
+		directory_loaded = true;
+	}
 
-	auto &airport = std::get<1>(*airport_it);
-	auto sid_it = airport.find(point);
-	if (sid_it == airport.end()) return nullptr;
+	std::lock_guard<std::mutex> _lock(update_lock);
+	directory_revision = directory_rev;
 
-	return std::get<1>(*sid_it);
+	spdlog::trace("directory loaded");
 }
 
-static void load(
-	std::vector<api::Airport> &airports,
-	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &sids
-) {
-	for (auto &airport : airports) {
-		spdlog::debug("adding {}", airport.icao.c_str());
+void PluginSource::fetch_snapshot(uint64_t snapshot_rev) {
+	spdlog::trace("fetching snapshot for revision {}", snapshot_rev);
 
-		auto &sid_map = sids[std::move(airport.icao)];
-
-		for (auto &sid_raw : airport.sids) {
-			auto ptr = std::make_shared<api::Sid>();
-			ptr->constraints = std::move(sid_raw.constraints);
-			ptr->restrictions = std::move(sid_raw.restrictions);
+	auto initial_cache_version = cache_version.load();
 
-			spdlog::debug("-> {}", sid_raw.point.c_str());
+	// the snapshot is loaded aside and swapped in, so checks are never blocked
+	// for longer than the swap
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> snapshot;
 
-			sid_map.insert_or_assign(std::move(sid_raw.point), ptr);
-			for (auto &alias : sid_raw.aliases)
-				sid_map.insert_or_assign(std::move(alias), ptr);
-		}
+	try {
+		load(fetch_body("airports"), snapshot, *constraint_pool);
+		constraint_pool->sweep();
+	} catch (...) {
+		if (!stopping.load()) report_exception("snapshot call");
+		return;
 	}
+
+	if (initial_cache_version != cache_version.load()) {
+		spdlog::trace("discarding snapshot due to cache invalidation");
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> _lock(cache_lock);
+
+		// airports which haven't changed keep their generation, and SID objects
+		for (auto &[icao, sid_map] : snapshot) {
+			auto old_it = sids.find(icao);
+			if (old_it == sids.end() || !reuse_unchanged(sid_map, std::get<1>(*old_it))) bump(icao);
+		}
+
+		for (const auto &[icao, _sid_map] : sids)
+			if (snapshot.find(icao) == snapshot.end()) bump(icao);
+
+		for (const auto &icao : pending) bump(icao);
+		for (const auto &icao : missing) bump(icao);
+		for (const auto &icao : error) bump(icao);
+
+		sids.swap(snapshot);
+		pending.clear();
+		missing.clear();
+		missing_order.clear();
+		error.clear();
+		meta.clear();
+
+		usage.clear();
+		lru.clear();
+		memory_used = 0;
+		for (const auto &[icao, _sid_map] : sids) account(icao);
+
+		snapshot_loaded = true;
+	}
+
+	std::lock_guard<std::mutex> _lock(update_lock);
+	snapshot_revision = snapshot_rev;
+
+	spdlog::trace("snapshot loaded");
+}
+
+void PluginSource::apply_changes(const api::Changes &changes) {
+	std::lock_guard<std::mutex> _lock(cache_lock);
+
+	// expired airports are refetched when they're next requested. airports
+	// without metadata were loaded from a file, so are left alone
+
+	auto now = Clock::now();
+
+	if (changes.reset) {
+		for (auto &[_icao, airport_meta] : meta) airport_meta.expires = now;
+		for (const auto &icao : missing) bump(icao);
+		missing.clear();
+		missing_order.clear();
+	}
+
+	for (const auto &icao : changes.changed) {
+		auto meta_it = meta.find(icao);
+		if (meta_it != meta.end()) {
+			auto &airport_meta = std::get<1>(*meta_it);
+			airport_meta.expires = now;
+			airport_meta.retry = now;
+
+			// loaded airports are refreshed straight away, being likely in use
+			if (sids.find(icao) != sids.end() && !airport_meta.refreshing) {
+				airport_meta.refreshing = true;
+				enqueue_fetch(icao.c_str(), Source::Priority::Background, true);
+			}
+		}
+
+		if (missing.erase(icao)) bump(icao);
+	}
+
+	prune_missing_order();
+
+	for (const auto &icao : changes.removed) {
+		if (meta.find(icao) == meta.end()) continue;
+
+		sids.erase(icao);
+		meta.erase(icao);
+		error.erase(icao);
+		account(icao);
+		remember_missing(icao);
+		bump(icao);
+	}
+
+	spdlog::trace(
+		"applied changes: {} changed, {} removed{}",
+		changes.changed.size(), changes.removed.size(), changes.reset ? ", reset" : ""
+	);
+}
+
+api::DateTime PluginSource::datetime() {
+	int64_t offset = clock_offset.load(std::memory_order_relaxed);
+	if (offset == CLOCK_UNKNOWN) return {};
+
+	int64_t now = ((local_ms(Clock::now()) + offset) % CLOCK_WEEK + CLOCK_WEEK) % CLOCK_WEEK;
+
+	api::DateTime datetime;
+	datetime.date = now / 86400000;
+	datetime.time = api::Time {
+		(uint8_t) (now / 3600000 % 24),
+		(uint8_t) (now / 60000 % 60),
+		(uint8_t) (now / 1000 % 60),
+	};
+
+	return datetime;
+}
+
+Source::CacheStatus PluginSource::airport(const char *icao, Source::Priority priority) {
+	std::lock_guard<std::mutex> _lock(cache_lock);
+
+	auto now = Clock::now();
+
+	if (error.find(icao) != error.end()) {
+		auto &airport_meta = meta[icao];
+		if (now < airport_meta.retry) return Source::CacheStatus::Error;
+
+		spdlog::trace("retrying airport {} after {} failures", icao, airport_meta.failures);
+
+		error.erase(icao);
+	}
+
+	if (missing.find(icao) != missing.end()) return Source::CacheStatus::Missing;
+	if (pending.find(icao) != pending.end()) {
+		promote_fetch(icao, priority);
+		return Source::CacheStatus::Pending;
+	}
+
+	if (sids.find(icao) != sids.end()) {
+		auto usage_it = usage.find(icao);
+		if (usage_it != usage.end() && std::get<1>(*usage_it).lru) {
+			lru.splice(lru.end(), lru, *std::get<1>(*usage_it).lru);
+			std::get<1>(*usage_it).used = Clock::now();
+		}
+
+		// airports without metadata were loaded from a file, and never expire
+		auto meta_it = meta.find(icao);
+		if (meta_it == meta.end()) return Source::CacheStatus::Extant;
+
+		// stale data is still served whilst the refresh is in flight
+		auto &airport_meta = std::get<1>(*meta_it);
+		if (now >= airport_meta.expires && !airport_meta.refreshing) {
+			spdlog::trace("airport {} expired; refreshing", icao);
+
+			airport_meta.refreshing = true;
+			enqueue_fetch(icao, Source::Priority::Background, true);
+		}
+
+		return Source::CacheStatus::Extant;
+	}
+
+	// the snapshot is complete, so anything not in it has no data. until it has
+	// loaded, fall back to fetching airports individually
+	if (snapshot_loaded) return Source::CacheStatus::Missing;
+
+	// the directory lists every airport with data, so there's no need to ask
+	if (directory_loaded) {
+		auto packed = pack_icao(icao);
+
+		if (!packed || !std::binary_search(directory.begin(), directory.end(), *packed)) {
+			remember_missing(icao);
+			return Source::CacheStatus::Missing;
+		}
+	}
+
+	// TODO: we could batch these requests, and have fetch_airport wait and then
+	// fetch all in pending
+
+	pending.insert(std::string(icao));
+	enqueue_fetch(icao, priority, false);
+
+	return Source::CacheStatus::Pending;
+}
+
+void PluginSource::enqueue_fetch(const char *icao, Source::Priority priority, bool refresh) {
+	FetchJob job;
+	job.icao = icao;
+	job.refresh = refresh;
+	job.cache_version = cache_version.load();
+
+	{
+		std::lock_guard<std::mutex> _lock(queue_lock);
+		queues[(size_t) priority].push_back(std::move(job));
+	}
+
+	queue_cv.notify_one();
+}
+
+void PluginSource::promote_fetch(const char *icao, Source::Priority priority) {
+	std::lock_guard<std::mutex> _lock(queue_lock);
+
+	// a queued fetch requested at a higher priority is moved up, so that it
+	// pre-empts everything beneath it. in-flight fetches are left alone
+	for (size_t level = 0; level < (size_t) priority; level++) {
+		auto &queue = queues[level];
+		auto it = std::find_if(queue.begin(), queue.end(), [icao](const FetchJob &job) {
+			return job.icao == icao;
+		});
+
+		if (it == queue.end()) continue;
+
+		spdlog::trace("promoting fetch for {}", icao);
+
+		queues[(size_t) priority].push_back(std::move(*it));
+		queue.erase(it);
+
+		return;
+	}
+}
+
+void PluginSource::fetch_worker() {
+	std::unique_lock<std::mutex> lock(queue_lock);
+
+	while (true) {
+		queue_cv.wait(lock, [this]() {
+			return stopping || std::any_of(
+				std::begin(queues), std::end(queues),
+				[](const auto &queue) { return !queue.empty(); }
+			);
+		});
+
+		if (stopping) return;
+
+		// the highest non-empty priority class goes first
+		auto queue = std::find_if(
+			std::rbegin(queues), std::rend(queues),
+			[](const auto &queue) { return !queue.empty(); }
+		);
+
+		FetchJob job = std::move(queue->front());
+		queue->pop_front();
+
+		lock.unlock();
+		fetch_airport(job);
+		lock.lock();
+	}
+}
+
+void PluginSource::fetch_airport(const FetchJob &job) {
+	spdlog::trace("requesting airport {}", job.icao);
+
+	const std::string &icao = job.icao;
+	bool refresh = job.refresh;
+
+	std::string path("airport?icao=");
+	path.append(icao); // URL-encoding shouldn't be an issue
+
+	auto initial_cache_version = job.cache_version;
+
+	std::vector<api::Airport> airports;
+	try {
+		airports = fetch<std::vector<api::Airport>>(path);
+	} catch (...) {
+		if (initial_cache_version != cache_version.load()) return;
+
+		std::lock_guard<std::mutex> _lock2(cache_lock);
+
+		pending.erase(icao);
+
+		try {
+			throw;
+		} catch (int code) {
+			// server returns 400 for non EG**, and 404 for unknown EG**
+			if (code == 400 || code == 404) {
+				sids.erase(icao);
+				meta.erase(icao);
+				account(icao);
+				remember_missing(icao);
+				bump(icao);
+				return;
+			}
+		} catch (...) {}
+
+		report_exception("airport request call");
+
+		auto &airport_meta = meta[icao];
+		airport_meta.failures++;
+
+		if (refresh) {
+			// keep serving the stale data, and try again later
+			airport_meta.refreshing = false;
+			airport_meta.expires = Clock::now() + backoff(airport_meta.failures);
+		} else {
+			airport_meta.retry = Clock::now() + backoff(airport_meta.failures);
+			error.insert(icao);
+			bump(icao);
+		}
+
+		return;
+	}
+
+	if (initial_cache_version != cache_version.load()) {
+		spdlog::trace("discarding fetch result due to cache invalidation");
+		return;
+	}
+
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> loaded;
+	load(airports, loaded, *constraint_pool);
+	constraint_pool->sweep();
+
+	std::lock_guard<std::mutex> _lock2(cache_lock);
+
+	// spread the expiry times so that airports loaded together don't all
+	// refresh together
+	auto &airport_meta = meta[icao];
+	airport_meta.failures = 0;
+	airport_meta.refreshing = false;
+	airport_meta.expires = Clock::now() + AIRPORT_TTL + jitter(std::chrono::seconds(AIRPORT_TTL) / 10);
+
+	// replace rather than merge, so that withdrawn SIDs don't linger
+	publish(loaded, refresh);
+	if (pending.erase(icao)) bump(icao);
+
+	evict();
+
+	spdlog::trace("airport request complete");
+}
+
+std::shared_ptr<const api::Sid> PluginSource::sid(const char *icao, const char *point) {
+	std::lock_guard<std::mutex> _lock(cache_lock);
+
+	auto airport_it = sids.find(icao);
+	if (airport_it == sids.end()) return nullptr;
+
+	auto &airport = std::get<1>(*airport_it);
+	auto sid_it = airport.find(point);
+	if (sid_it == airport.end()) return nullptr;
+
+	return std::get<1>(*sid_it);
+}
+
+void PluginSource::bump(const std::string &icao) {
+	generations.insert_or_assign(icao, ++generation_counter);
+}
+
+void PluginSource::publish(
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &loaded,
+	bool replace
+) {
+	for (auto &[icao, sid_map] : loaded) {
+		auto old_it = sids.find(icao);
+
+		if (old_it == sids.end()) {
+			sids.emplace(icao, std::move(sid_map));
+			bump(icao);
+			continue;
+		}
+
+		auto &old_map = std::get<1>(*old_it);
+
+		if (!replace) {
+			// SIDs not in the new data are kept
+			for (const auto &[point, sid] : old_map) sid_map.try_emplace(point, sid);
+		}
+
+		if (!reuse_unchanged(sid_map, old_map)) bump(icao);
+		old_map = std::move(sid_map);
+	}
+
+	for (const auto &[icao, _sid_map] : loaded) account(icao);
+	loaded.clear();
+}
+
+void PluginSource::account(const std::string &icao) {
+	// a refresh doesn't count as a use
+	auto used = Clock::now();
+
+	auto usage_it = usage.find(icao);
+	if (usage_it != usage.end()) {
+		auto &airport_usage = std::get<1>(*usage_it);
+
+		used = airport_usage.used;
+		memory_used -= airport_usage.bytes;
+		if (airport_usage.lru) lru.erase(*airport_usage.lru);
+		usage.erase(usage_it);
+	}
+
+	auto sids_it = sids.find(icao);
+	if (sids_it == sids.end()) return;
+
+	AirportUsage airport_usage;
+	airport_usage.bytes = footprint(icao, std::get<1>(*sids_it));
+	airport_usage.used = used;
+
+	// only fetched airports can be evicted, as they can be fetched again
+	if (meta.find(icao) != meta.end()) airport_usage.lru = lru.insert(lru.end(), icao);
+
+	memory_used += airport_usage.bytes;
+	usage.emplace(icao, airport_usage);
+}
+
+void PluginSource::evict() {
+	auto now = Clock::now();
+
+	while (memory_limit && memory_used > memory_limit && !lru.empty()) {
+		// the most recently used airport, and any used lately (including those
+		// just published), are kept
+		if (lru.size() == 1 || now - usage.at(lru.front()).used < EVICT_IDLE_MIN) {
+			if (!over_limit_reported) {
+				report_message("Airports in use need more memory than the limit; keeping them until unused");
+				over_limit_reported = true;
+			}
+
+			return;
+		}
+
+		std::string icao = std::move(lru.front());
+
+		spdlog::debug("evicting {} to save memory", icao);
+
+		sids.erase(icao);
+		meta.erase(icao);
+		account(icao);
+		bump(icao);
+	}
+
+	if (!memory_limit || memory_used <= memory_limit) over_limit_reported = false;
+}
+
+void PluginSource::remember_missing(const std::string &icao) {
+	if (!missing.insert(icao).second) return;
+	missing_order.push_back(icao);
+
+	// these are cheap to find again, with the directory or a single request
+	if (missing.size() > MISSING_MAX) {
+		std::string forgotten = std::move(missing_order.front());
+		missing_order.pop_front();
+
+		missing.erase(forgotten);
+		bump(forgotten);
+	}
+}
+
+// drops airports no longer missing from the order, so that it matches the set
+void PluginSource::prune_missing_order() {
+	missing_order.erase(
+		std::remove_if(missing_order.begin(), missing_order.end(), [this](const std::string &icao) {
+			return missing.find(icao) == missing.end();
+		}),
+		missing_order.end()
+	);
+}
+
+PluginSource::MemoryStats PluginSource::memory_stats(size_t largest) {
+	std::lock_guard<std::mutex> _lock(cache_lock);
+
+	MemoryStats stats {};
+	stats.airports = sids.size();
+	stats.bytes = memory_used;
+	stats.limit = memory_limit;
+	stats.pending = pending.size();
+	stats.missing = missing.size();
+	stats.error = error.size();
+
+	for (const auto &[_icao, sid_map] : sids) {
+		std::set<const api::Sid *> unique;
+		for (const auto &[_point, sid] : sid_map) unique.insert(sid.get());
+		stats.sids += unique.size();
+	}
+
+	for (const auto &[icao, airport_usage] : usage)
+		stats.largest.emplace_back(icao, airport_usage.bytes);
+
+	auto by_size = [](const auto &a, const auto &b) { return std::get<1>(a) > std::get<1>(b); };
+	size_t count = std::min(largest, stats.largest.size());
+
+	std::partial_sort(stats.largest.begin(), stats.largest.begin() + count, stats.largest.end(), by_size);
+	stats.largest.resize(count);
+
+	return stats;
+}
+
+void PluginSource::set_memory_limit(size_t bytes) {
+	std::lock_guard<std::mutex> _lock(cache_lock);
+
+	memory_limit = bytes;
+	evict();
+}
+
+uint64_t PluginSource::generation(const char *icao) {
+	std::lock_guard<std::mutex> _lock(cache_lock);
+
+	auto it = generations.find(icao);
+	return it == generations.end()
+		? invalidated_generation
+		: std::max(std::get<1>(*it), invalidated_generation);
+}
+
+void PluginSource::Endpoint::record(double ms) {
+	std::lock_guard<std::mutex> _lock(lock);
+
+	average = samples.empty() ? ms : average + (ms - average) * ENDPOINT_SMOOTHING;
+
+	samples.push_back(ms);
+	if (samples.size() > ENDPOINT_SAMPLES) samples.pop_front();
+}
+
+double PluginSource::Endpoint::rank() {
+	std::lock_guard<std::mutex> _lock(lock);
+
+	// untried endpoints rank last, but are sampled whenever a request is hedged
+	return samples.empty() ? std::numeric_limits<double>::infinity() : average;
+}
+
+PluginSource::Clock::duration PluginSource::Endpoint::hedge_delay() {
+	std::vector<double> sorted;
+
+	{
+		std::lock_guard<std::mutex> _lock(lock);
+		if (samples.size() < ENDPOINT_SAMPLES / 4) return HEDGE_DEFAULT;
+
+		sorted.assign(samples.begin(), samples.end());
+	}
+
+	auto p95 = sorted.begin() + sorted.size() * 95 / 100;
+	std::nth_element(sorted.begin(), p95, sorted.end());
+
+	auto delay = std::chrono::duration<double, std::milli>(*p95);
+	return std::max(std::chrono::duration_cast<Clock::duration>(delay), Clock::duration(HEDGE_MIN));
+}
+
+std::string PluginSource::fetch_body(const std::string &path) {
+	std::vector<std::shared_ptr<Endpoint>> order;
+
+	{
+		std::lock_guard<std::mutex> _lock(endpoints_lock);
+		order = endpoints;
+	}
+
+	// the fastest endpoint recently is tried first; ties keep the given order
+	std::vector<std::pair<double, std::shared_ptr<Endpoint>>> ranked;
+	for (auto &endpoint : order) ranked.emplace_back(endpoint->rank(), endpoint);
+
+	std::stable_sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+		return a.first < b.first;
+	});
+
+	struct Attempt {
+		std::shared_ptr<Endpoint> endpoint;
+		std::unique_ptr<std::atomic_bool> stop;
+		std::future<HttpClient::Response> response;
+		Clock::time_point start;
+	};
+
+	std::vector<Attempt> attempts;
+	std::optional<HttpClient::Response> answer;
+	std::exception_ptr last_error;
+	Clock::time_point hedge_at;
+
+	auto launch = [&]() {
+		Attempt attempt;
+		attempt.endpoint = std::get<1>(ranked[attempts.size()]);
+		attempt.stop = std::make_unique<std::atomic_bool>(false);
+		attempt.start = Clock::now();
+
+		std::string url = attempt.endpoint->url + path;
+		spdlog::trace("fetch {}", url);
+
+		attempt.response = std::async(
+			std::launch::async,
+			[this, url = std::move(url), stop = attempt.stop.get()]() { return http->get(url.c_str(), *stop); }
+		);
+
+		hedge_at = attempt.start + attempt.endpoint->hedge_delay();
+		attempts.push_back(std::move(attempt));
+	};
+
+	launch();
+
+	// if the first endpoint hasn't answered by its usual worst case, the request
+	// is duplicated to the next, and so on. whichever answers first is used; a
+	// failed attempt moves on to the next endpoint straight away
+
+	while (!answer) {
+		bool active = false;
+
+		for (auto &attempt : attempts) {
+			if (!attempt.response.valid()) continue;
+
+			if (attempt.response.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				active = true;
+				continue;
+			}
+
+			std::chrono::duration<double, std::milli> latency = Clock::now() - attempt.start;
+
+			try {
+				auto response = attempt.response.get();
+
+				// the server may be overloaded; another might not be
+				if (response.code >= 500) throw (int) response.code;
+
+				attempt.endpoint->record(latency.count());
+				answer = std::move(response);
+				break;
+			} catch (...) {
+				if (!stopping.load()) attempt.endpoint->record(std::max(latency.count(), FAILURE_PENALTY_MS));
+				last_error = std::current_exception();
+			}
+		}
+
+		if (answer || stopping.load()) break;
+
+		if (!active || Clock::now() >= hedge_at) {
+			if (attempts.size() < ranked.size()) {
+				if (active) spdlog::trace("hedging request for {}", path);
+				launch();
+				continue;
+			}
+
+			if (!active) break;
+		}
+
+		// all attempts are in flight, so wait a little for any of them
+		for (auto &attempt : attempts) {
+			if (!attempt.response.valid()) continue;
+
+			attempt.response.wait_for(HEDGE_POLL);
+			break;
+		}
+	}
+
+	// abandon the losers; their futures wait for them to stop when destroyed
+	for (auto &attempt : attempts) *attempt.stop = true;
+
+	if (!answer) {
+		if (stopping.load() || !last_error) throw std::string("request cancelled");
+		std::rethrow_exception(last_error);
+	}
+
+	if (answer->code < 200 || answer->code >= 300) {
+		/* std::snprintf(error, CURL_ERROR_SIZE, "server returned code %ld", code);
+		throw std::string(error); */
+
+		throw (int) answer->code;
+	}
+
+	return std::move(answer->body);
+}
+
+StaticSource::StaticSource(json &data, api::DateTime datetime) :
+	datetime_value(datetime)
+{
+	auto airports = data.template get<std::vector<api::Airport>>();
+	auto loaded = std::make_shared<std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>>>();
+
+	ConstraintPool pool;
+	load(airports, *loaded, pool);
+
+	sids = std::move(loaded);
+}
+
+StaticSource::StaticSource(const char *path, api::DateTime datetime) :
+	datetime_value(datetime)
+{
+	MappedFile file(path);
+	auto loaded = std::make_shared<std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>>>();
+
+	ConstraintPool pool;
+	load(file.view(), *loaded, pool);
+
+	sids = std::move(loaded);
+}
+
+StaticSource::StaticSource(const StaticSource &rules, api::DateTime datetime) :
+	datetime_value(datetime), sids(rules.sids) {}
+
+api::DateTime StaticSource::datetime() {
+	return datetime_value;
+}
+
+void StaticSource::set_datetime(api::DateTime datetime) {
+	datetime_value = datetime;
+}
+
+Source::CacheStatus StaticSource::airport(const char *icao, Source::Priority _priority) {
+	return sids->find(icao) == sids->end()
+		? Source::CacheStatus::Missing
+		: Source::CacheStatus::Extant;
+}
+
+std::shared_ptr<const api::Sid> StaticSource::sid(const char *icao, const char *point) {
+	auto airport_it = sids->find(icao);
+	if (airport_it == sids->end()) return nullptr;
+
+	auto &airport = std::get<1>(*airport_it);
+	auto sid_it = airport.find(point);
+	if (sid_it == airport.end()) return nullptr;
+
+	return std::get<1>(*sid_it);
+}
+
+static void load(
+	std::vector<api::Airport> &airports,
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &sids,
+	ConstraintPool &pool
+) {
+	// checked once, as this may run for thousands of SIDs
+	bool debug = spdlog::should_log(spdlog::level::debug);
+
+	for (auto &airport : airports) {
+		if (debug) spdlog::debug("adding {}", airport.icao.c_str());
+
+		auto &sid_map = sids[std::move(airport.icao)];
+
+		for (auto &sid_raw : airport.sids) {
+			auto ptr = std::make_shared<api::Sid>();
+			ptr->restrictions = pool.intern(sid_raw.restrictions);
+
+			ptr->constraints.reserve(sid_raw.constraints.size());
+			for (auto &constraint : sid_raw.constraints)
+				ptr->constraints.push_back(pool.intern(std::move(constraint)));
+
+			if (debug) spdlog::debug("-> {}", sid_raw.point.c_str());
+
+			sid_map.insert_or_assign(std::move(sid_raw.point), ptr);
+			for (auto &alias : sid_raw.aliases)
+				sid_map.insert_or_assign(std::move(alias), ptr);
+		}
+	}
+}
+
+// finds the elements of a top-level JSON array, without parsing them, or
+// returns false if the data isn't a well-formed array
+static bool split_array(std::string_view data, std::vector<std::string_view> &elements) {
+	auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+
+	size_t i = 0, n = data.length();
+	while (i < n && is_space(data[i])) i++;
+	if (i == n || data[i++] != '[') return false;
+
+	while (true) {
+		while (i < n && is_space(data[i])) i++;
+		if (i == n) return false;
+		if (data[i] == ']' && elements.empty()) {
+			i++;
+			break;
+		}
+
+		size_t start = i;
+		unsigned depth = 0;
+
+		for (; i < n; i++) {
+			char c = data[i];
+
+			if (c == '"') {
+				for (i++; i < n && data[i] != '"'; i++)
+					if (data[i] == '\\') i++;
+			} else if (c == '[' || c == '{') {
+				depth++;
+			} else if (c == ']' || c == '}') {
+				if (!depth) break;
+				depth--;
+			} else if (c == ',' && !depth) {
+				break;
+			}
+		}
+
+		if (i >= n) return false;
+
+		size_t end = i;
+		while (end > start && is_space(data[end - 1])) end--;
+		elements.push_back(data.substr(start, end - start));
+
+		if (data[i++] == ']') break;
+	}
+
+	while (i < n && is_space(data[i])) i++;
+	return i == n;
+}
+
+// parses an array of airports and adds them to the table. large rulesets are
+// split into chunks of airports, which are parsed and compiled in parallel and
+// merged in order, so the result is the same as loading them in sequence.
+static void load(
+	std::string_view data,
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &sids,
+	ConstraintPool &pool
+) {
+	std::vector<std::string_view> elements;
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+	if (!split_array(data, elements) || elements.size() < 2 * LOAD_CHUNK_MIN || threads < 2) {
+		// malformed data is also parsed here, for the error message
+		auto airports = nlohmann::jsonify::parse<std::vector<api::Airport>>(data);
+		load(airports, sids, pool);
+		return;
+	}
+
+	size_t chunks = std::min<size_t>(threads, elements.size() / LOAD_CHUNK_MIN);
+	spdlog::debug("loading {} airports in {} chunks", elements.size(), chunks);
+
+	using Table = std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>>;
+	std::vector<std::future<Table>> results;
+
+	for (size_t chunk = 0; chunk < chunks; chunk++) {
+		size_t first = elements.size() * chunk / chunks, last = elements.size() * (chunk + 1) / chunks;
+
+		results.push_back(std::async(std::launch::async, [&elements, &pool, first, last]() {
+			std::vector<api::Airport> airports;
+			airports.reserve(last - first);
+
+			for (size_t i = first; i < last; i++)
+				airports.push_back(nlohmann::jsonify::parse<api::Airport>(elements[i]));
+
+			Table table;
+			load(airports, table, pool);
+			return table;
+		}));
+	}
+
+	// every chunk is waited for before any exception is rethrown, as they
+	// reference the elements
+	std::vector<Table> tables;
+	std::exception_ptr first_error;
+
+	for (auto &result : results) {
+		try {
+			tables.push_back(result.get());
+		} catch (...) {
+			if (!first_error) first_error = std::current_exception();
+		}
+	}
+
+	if (first_error) std::rethrow_exception(first_error);
+
+	for (auto &table : tables) merge(table, sids);
+}
+
+// moves the airports of one table into another, replacing SIDs which are
+// already present, as loading them after would
+static void merge(
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &from,
+	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &into
+) {
+	for (auto &[icao, sid_map] : from) {
+		auto [it, inserted] = into.try_emplace(icao, std::move(sid_map));
+		if (inserted) continue;
+
+		for (auto &[point, sid] : sid_map)
+			std::get<1>(*it).insert_or_assign(point, std::move(sid));
+	}
+
+	from.clear();
+}
+
+// replaces the SIDs of an airport's new data with the old objects wherever
+// they are equal, and returns whether the two are the same
+static bool reuse_unchanged(
+	std::map<std::string, std::shared_ptr<api::Sid>> &fresh,
+	const std::map<std::string, std::shared_ptr<api::Sid>> &old
+) {
+	bool same = fresh.size() == old.size();
+
+	// aliases share objects, so each is only compared once
+	std::map<const api::Sid *, std::shared_ptr<api::Sid>> replacements;
+
+	for (auto &[point, sid] : fresh) {
+		auto old_it = old.find(point);
+		if (old_it == old.end()) {
+			same = false;
+			continue;
+		}
+
+		auto &old_sid = std::get<1>(*old_it);
+
+		auto replacement_it = replacements.find(sid.get());
+		if (replacement_it == replacements.end()) {
+			auto replacement = *sid == *old_sid ? old_sid : nullptr;
+			replacement_it = replacements.emplace(sid.get(), replacement).first;
+		}
+
+		auto &replacement = std::get<1>(*replacement_it);
+		if (replacement == old_sid) {
+			sid = replacement;
+		} else {
+			same = false;
+		}
+	}
+
+	return same;
+}
+
+// estimates of the heap memory used by the airport data, beyond the objects
+// themselves. map nodes are assumed to carry four pointers of overhead (as in
+// the common red-black tree implementations).
+
+const size_t MAP_NODE_OVERHEAD = 4 * sizeof(void *);
+
+// lists and constraints already counted for an airport, which may be shared
+using Counted = std::set<const void *>;
+
+static size_t heap_size(const std::string &str, Counted &) {
+	static const size_t small_capacity = std::string().capacity();
+	return str.capacity() > small_capacity ? str.capacity() + 1 : 0;
+}
+
+static size_t heap_size(const api::Alert &alert, Counted &counted);
+static size_t heap_size(const api::Restriction &restriction, Counted &counted);
+static size_t heap_size(const api::Constraint &constraint, Counted &counted);
+
+template<typename T>
+static size_t heap_size(const T &, Counted &) {
+	return 0;
+}
+
+template<typename T>
+static size_t heap_size(const std::optional<T> &value, Counted &counted) {
+	return value ? heap_size(*value, counted) : 0;
+}
+
+template<typename T>
+static size_t heap_size(const std::vector<T> &values, Counted &counted) {
+	size_t size = values.capacity() * sizeof(T);
+	for (const auto &value : values) size += heap_size(value, counted);
+	return size;
+}
+
+// lists shared with other airports are counted for each, as they would be
+// freed with the last of them
+template<typename T>
+static size_t heap_size(const api::SharedList<T> &list, Counted &counted) {
+	if (!list.shared() || !counted.insert(list.shared().get()).second) return 0;
+	return sizeof(std::vector<T>) + 2 * sizeof(void *) + heap_size(list.get(), counted);
+}
+
+static size_t heap_size(const api::Alert &alert, Counted &counted) {
+	return heap_size(alert.note, counted);
+}
+
+static size_t heap_size(const api::Restriction &restriction, Counted &counted) {
+	return heap_size(restriction.alt, counted) + heap_size(restriction.suffix, counted)
+		+ heap_size(restriction.types, counted);
+}
+
+static size_t heap_size(const api::Constraint &constraint, Counted &counted) {
+	return heap_size(constraint.dests, counted) + heap_size(constraint.nodests, counted)
+		+ heap_size(constraint.points, counted) + heap_size(constraint.nopoints, counted)
+		+ heap_size(constraint.route, counted) + heap_size(constraint.noroute, counted)
+		+ heap_size(constraint.alerts, counted) + heap_size(constraint.restrictions, counted);
+}
+
+static size_t footprint(const std::string &icao, const std::map<std::string, std::shared_ptr<api::Sid>> &sid_map) {
+	using SidMap = std::map<std::string, std::shared_ptr<api::Sid>>;
+
+	Counted counted;
+
+	// the airport's node in the cache, and its SIDs' nodes
+	size_t size = sizeof(std::pair<const std::string, SidMap>) + MAP_NODE_OVERHEAD + heap_size(icao, counted);
+
+	for (const auto &[point, sid] : sid_map) {
+		size += sizeof(SidMap::value_type) + MAP_NODE_OVERHEAD + heap_size(point, counted);
+
+		// aliases share their SID, which is counted once, with its control block
+		if (!counted.insert(sid.get()).second) continue;
+
+		size += sizeof(api::Sid) + 2 * sizeof(void *);
+		size += heap_size(sid->constraints, counted) + heap_size(sid->restrictions, counted);
+
+		// constraints, like lists, are counted once for each airport using them
+		for (const auto &constraint : sid->constraints)
+			if (counted.insert(constraint.get()).second)
+				size += sizeof(api::Constraint) + 2 * sizeof(void *) + heap_size(*constraint, counted);
+	}
+
+	return size;
+}
+
+// structural hashes, consistent with the api types' operator==
+
+static void hash_combine(size_t &seed, size_t value) {
+	seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+static size_t hash_value(const std::string &str) {
+	return std::hash<std::string>()(str);
+}
+
+template<typename T, typename = std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>>
+static size_t hash_value(T value) {
+	return std::hash<T>()(value);
+}
+
+static size_t hash_value(const api::Time &time);
+static size_t hash_value(const api::DateTime &datetime);
+static size_t hash_value(const api::Alert &alert);
+static size_t hash_value(const api::Restriction &restriction);
+
+template<typename T>
+static size_t hash_value(const std::optional<T> &value) {
+	return value ? hash_value(*value) + 1 : 0;
+}
+
+template<typename T>
+static size_t hash_value(const std::vector<T> &values) {
+	size_t seed = values.size();
+	for (const auto &value : values) hash_combine(seed, hash_value(value));
+	return seed;
+}
+
+template<typename T>
+static size_t hash_value(const api::SharedList<T> &list) {
+	return hash_value(list.get());
+}
+
+template<typename... Ts>
+static size_t hash_fields(const Ts &...fields) {
+	size_t seed = 0;
+	(hash_combine(seed, hash_value(fields)), ...);
+	return seed;
+}
+
+static size_t hash_value(const api::Time &time) {
+	return hash_fields(time.hour, time.minute, time.second);
+}
+
+static size_t hash_value(const api::DateTime &datetime) {
+	return hash_fields(datetime.date, datetime.time);
+}
+
+static size_t hash_value(const api::Alert &alert) {
+	return hash_fields(alert.ban, alert.warn, alert.note, alert.srd);
+}
+
+static size_t hash_value(const api::Restriction &restriction) {
+	return hash_fields(
+		restriction.sidlevel, restriction.banned, restriction.alt, restriction.suffix,
+		restriction.types, restriction.start, restriction.end
+	);
+}
+
+static size_t hash_value(const api::Constraint &constraint) {
+	return hash_fields(
+		constraint.min, constraint.max, constraint.dir, constraint.dests, constraint.nodests,
+		constraint.points, constraint.nopoints, constraint.route, constraint.noroute,
+		constraint.alerts, constraint.restrictions
+	);
+}
+
+template<typename T>
+std::shared_ptr<const T> InternTable<T>::intern(std::shared_ptr<const T> value, size_t hash) {
+	std::lock_guard<std::mutex> _lock(lock);
+
+	auto &bucket = buckets[hash];
+
+	for (auto it = bucket.begin(); it != bucket.end();) {
+		auto existing = it->lock();
+
+		if (!existing) {
+			it = bucket.erase(it);
+		} else if (existing == value || *existing == *value) {
+			return existing;
+		} else {
+			it++;
+		}
+	}
+
+	bucket.push_back(value);
+	return value;
+}
+
+template<typename T>
+void InternTable<T>::sweep() {
+	std::lock_guard<std::mutex> _lock(lock);
+
+	if (buckets.size() < sweep_at) return;
+
+	for (auto it = buckets.begin(); it != buckets.end();) {
+		auto &bucket = std::get<1>(*it);
+		bucket.erase(
+			std::remove_if(bucket.begin(), bucket.end(), [](const auto &entry) { return entry.expired(); }),
+			bucket.end()
+		);
+
+		it = bucket.empty() ? buckets.erase(it) : std::next(it);
+	}
+
+	sweep_at = std::max<size_t>(1024, buckets.size() * 2);
+}
+
+// empty lists are never allocated, so aren't interned
+
+api::SharedList<std::string> ConstraintPool::intern(const api::SharedList<std::string> &list) {
+	if (list.empty()) return {};
+	return string_lists.intern(list.shared(), hash_value(list.get()));
+}
+
+api::SharedList<api::Restriction> ConstraintPool::intern(const api::SharedList<api::Restriction> &list) {
+	if (list.empty()) return {};
+
+	// copying restrictions only copies pointers to their lists
+	auto restrictions = std::make_shared<std::vector<api::Restriction>>(list.get());
+	for (auto &restriction : *restrictions) {
+		restriction.alt = intern(restriction.alt);
+		restriction.suffix = intern(restriction.suffix);
+		restriction.types = intern(restriction.types);
+	}
+
+	return restriction_lists.intern(std::move(restrictions), hash_value(list.get()));
+}
+
+std::shared_ptr<const api::Constraint> ConstraintPool::intern(api::Constraint &&constraint) {
+	for (auto *list : {
+		&constraint.dests, &constraint.nodests, &constraint.points,
+		&constraint.nopoints, &constraint.route, &constraint.noroute,
+	}) *list = intern(*list);
+
+	constraint.restrictions = intern(constraint.restrictions);
+
+	size_t hash = hash_value(constraint);
+	return constraints.intern(std::make_shared<const api::Constraint>(std::move(constraint)), hash);
+}
+
+void ConstraintPool::sweep() {
+	constraints.sweep();
+	restriction_lists.sweep();
+	string_lists.sweep();
 }
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <list>
 #include <future>
 #include <map>
 #include <memory>
@@ -10,14 +15,19 @@
 #include <set>
 #include <shared_mutex>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "http.hpp"
+
 namespace api {
 	struct Time {
 		uint8_t hour, minute;
+		std::optional<uint8_t> second;
 
 		uint16_t ord() const {
 			return (uint16_t) hour * 60 + (uint16_t) minute;
@@ -40,24 +50,105 @@ namespace api {
 		std::optional<uint32_t> srd;
 	};
 
+	// a read-only list, which is shared with any other equal lists once interned
+	template<typename T>
+	class SharedList {
+	private:
+		std::shared_ptr<const std::vector<T>> items;
+
+		static const std::vector<T> &none() {
+			static const std::vector<T> empty;
+			return empty;
+		}
+
+	public:
+		using value_type = T;
+
+		SharedList() = default;
+		SharedList(std::shared_ptr<const std::vector<T>> items) : items(std::move(items)) {}
+
+		// replaces the list with a new one to be filled in place, before sharing
+		std::vector<T> &fill() {
+			auto fresh = std::make_shared<std::vector<T>>();
+			items = fresh;
+			return *fresh;
+		}
+
+		const std::vector<T> &get() const { return items ? *items : none(); }
+		const std::shared_ptr<const std::vector<T>> &shared() const { return items; }
+		operator const std::vector<T> &() const { return get(); }
+
+		auto begin() const { return get().begin(); }
+		auto end() const { return get().end(); }
+		size_t size() const { return get().size(); }
+		bool empty() const { return get().empty(); }
+		const T &operator[](size_t i) const { return get()[i]; }
+	};
+
 	struct Restriction {
 		bool sidlevel, banned;
-		std::vector<std::string> alt, suffix, types;
+		SharedList<std::string> alt, suffix, types;
 		std::optional<DateTime> start, end;
 	};
 
 	struct Constraint {
 		std::optional<uint16_t> min, max;
 		std::optional<Direction> dir;
-		std::vector<std::string> dests, nodests, points, nopoints, route, noroute;
+		SharedList<std::string> dests, nodests, points, nopoints, route, noroute;
 		std::vector<Alert> alerts;
-		std::vector<Restriction> restrictions;
+		SharedList<Restriction> restrictions;
 	};
 
+	// constraints, restriction lists and string lists are shared with any equal
+	// ones elsewhere in the data
 	struct Sid {
-		std::vector<Constraint> constraints;
-		std::vector<Restriction> restrictions;
+		std::vector<std::shared_ptr<const Constraint>> constraints;
+		SharedList<Restriction> restrictions;
 	};
+
+	// structural equality, for finding which airports changed on reload
+
+	inline bool operator==(const Time &a, const Time &b) {
+		return std::tie(a.hour, a.minute, a.second) == std::tie(b.hour, b.minute, b.second);
+	}
+
+	inline bool operator==(const DateTime &a, const DateTime &b) {
+		return std::tie(a.date, a.time) == std::tie(b.date, b.time);
+	}
+
+	template<typename T>
+	inline bool operator==(const SharedList<T> &a, const SharedList<T> &b) {
+		return a.shared() == b.shared() || a.get() == b.get();
+	}
+
+	template<typename T>
+	inline bool operator!=(const SharedList<T> &a, const SharedList<T> &b) {
+		return !(a == b);
+	}
+
+	inline bool operator==(const Alert &a, const Alert &b) {
+		return std::tie(a.ban, a.warn, a.note, a.srd) == std::tie(b.ban, b.warn, b.note, b.srd);
+	}
+
+	inline bool operator==(const Restriction &a, const Restriction &b) {
+		return std::tie(a.sidlevel, a.banned, a.alt, a.suffix, a.types, a.start, a.end)
+			== std::tie(b.sidlevel, b.banned, b.alt, b.suffix, b.types, b.start, b.end);
+	}
+
+	inline bool operator==(const Constraint &a, const Constraint &b) {
+		return std::tie(a.min, a.max, a.dir, a.dests, a.nodests, a.points, a.nopoints, a.route, a.noroute, a.alerts, a.restrictions)
+			== std::tie(b.min, b.max, b.dir, b.dests, b.nodests, b.points, b.nopoints, b.route, b.noroute, b.alerts, b.restrictions);
+	}
+
+	inline bool operator==(const Sid &a, const Sid &b) {
+		return a.restrictions == b.restrictions && std::equal(
+			a.constraints.begin(), a.constraints.end(), b.constraints.begin(), b.constraints.end(),
+			[](const auto &a, const auto &b) { return a == b || *a == *b; }
+		);
+	}
+
+	struct Version;
+	struct Changes;
 }
 
 class Source {
@@ -69,66 +160,215 @@ public:
 		Error,
 	};
 
+	// the urgency of fetching data which isn't available yet, lowest first
+	enum class Priority {
+		Background, // prefetches and refreshes
+		Explicit,   // checks requested by the user
+		Visible,    // tag items on screen
+	};
+
 	virtual api::DateTime datetime() {
 		return {};
 	}
 
-	virtual CacheStatus airport(const char *_icao) {
+	virtual CacheStatus airport(const char *_icao, Priority _priority = Priority::Visible) {
 		return CacheStatus::Missing;
 	}
 
 	virtual std::shared_ptr<const api::Sid> sid(const char *_icao, const char *_point) {
 		return nullptr;
 	}
+
+	// increases whenever the data or status of the airport changes, so results
+	// of checks may be kept until it does. SIDs which haven't changed are kept
+	// as the same object across reloads.
+	virtual uint64_t generation(const char *_icao) {
+		return 0;
+	}
 };
 
-#ifndef VFPC_STANDALONE
+class ConstraintPool;
+
 // this class deals in multithreading, but its public APIs must only be called
 // from one thread to ensure safety. this is acceptable in the current system.
 class PluginSource : public virtual Source {
 private:
+	using Clock = std::chrono::steady_clock;
+
+	// freshness of extant airports, and retry schedule of errored airports
+	struct AirportMeta {
+		Clock::time_point expires, retry;
+		unsigned failures = 0;
+		bool refreshing = false;
+	};
+
+	struct FetchJob {
+		std::string icao;
+		bool refresh;
+		unsigned cache_version;
+	};
+
+	// an equivalent server, with its recent response times
+	class Endpoint {
+	private:
+		std::mutex lock;
+		std::deque<double> samples;
+		double average = 0.0;
+
+	public:
+		const std::string url;
+
+		Endpoint(std::string url) : url(std::move(url)) {}
+
+		void record(double ms);
+		double rank();
+		Clock::duration hedge_delay();
+	};
+
+	std::unique_ptr<HttpClient> http;
+	std::unique_ptr<ConstraintPool> constraint_pool;
+
 	std::set<std::string> pending, missing, error;
+	std::map<std::string, AirportMeta> meta;
+
+	// the order in which airports were found missing, oldest first
+	std::deque<std::string> missing_order;
+
+	// estimated memory use of each airport, and the order in which evictable
+	// (i.e. fetched) airports were last used, least recent first
+	struct AirportUsage {
+		size_t bytes;
+		std::optional<std::list<std::string>::iterator> lru;
+		Clock::time_point used;
+	};
+
+	std::map<std::string, AirportUsage> usage;
+	std::list<std::string> lru;
+	size_t memory_used = 0, memory_limit = 0;
+	bool over_limit_reported = false;
+
+	// the generation of each airport which has changed, and of the last
+	// invalidation, which changes every airport
+	std::map<std::string, uint64_t> generations;
+	uint64_t generation_counter = 0, invalidated_generation = 0;
+	bool snapshot_loaded = false;
+
+	// sorted packed ICAO codes of every airport the server has data for
+	std::vector<uint32_t> directory;
+	bool directory_loaded = false;
 	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> sids;
-	std::string web_source;
 
-	api::DateTime datetime_value;
+	// the primary server and its mirrors, guarded by endpoints_lock
+	std::vector<std::shared_ptr<Endpoint>> endpoints;
+
+	// the API time (milliseconds into the week) at the epoch of the local clock,
+	// or CLOCK_UNKNOWN, so that the current time needs neither lock nor request
+	std::atomic<int64_t> clock_offset;
+	std::optional<uint64_t> revision, snapshot_revision, directory_revision;
 
 	std::atomic_uint cache_version;
-	std::mutex cache_lock, update_lock;
+	std::atomic_bool snapshot_mode, snapshot_loading, subscribed;
+
+	// one queue per priority class
+	std::deque<FetchJob> queues[3];
+	std::vector<std::thread> workers;
+	std::thread subscriber;
+	std::condition_variable queue_cv, stop_cv;
+	std::mutex queue_lock;
+
+	// set on destruction, cancelling all in-flight transfers
+	std::atomic_bool stopping;
+
+	// set on destruction or change of endpoints, ending the notification stream
+	std::atomic_bool resubscribe;
+	std::mutex cache_lock, update_lock, endpoints_lock, sync_lock;
 	std::shared_mutex this_lock;
 
+	std::string fetch_body(const std::string &path);
+	template<typename T> T fetch(const std::string &path);
 	void fetch_update(std::promise<void> promise);
-	void fetch_airport(std::promise<void> promise, const char *icao);
+	void load_file(std::string path, std::promise<void> promise);
+	void correct_clock(const api::Version &version, Clock::time_point sent, Clock::time_point received);
+	void sync(std::optional<uint64_t> new_revision);
+	void subscribe();
+	void fetch_directory(uint64_t directory_rev);
+	void fetch_snapshot(uint64_t snapshot_rev);
+	void apply_changes(const api::Changes &changes);
+	void fetch_worker();
+	void fetch_airport(const FetchJob &job);
+	void enqueue_fetch(const char *icao, Source::Priority priority, bool refresh);
+	void promote_fetch(const char *icao, Source::Priority priority);
+
+	// these must be called with cache_lock held
+	void bump(const std::string &icao);
+	void publish(std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> &loaded, bool replace);
+	void account(const std::string &icao);
+	void evict();
+	void remember_missing(const std::string &icao);
+	void prune_missing_order();
 
 public:
-	PluginSource();
+	PluginSource(std::unique_ptr<HttpClient> = std::make_unique<CurlHttpClient>());
 	~PluginSource();
 
+	// sets a space-separated list of equivalent servers, or loads a file in the
+	// background
 	void set(const char *source);
 	void invalidate();
 	void update();
 
+	// in snapshot mode, the whole ruleset is downloaded in one request on
+	// startup and on revision change, instead of fetching airports on demand
+	void set_snapshot(bool snapshot);
+
+	// whether change notifications are being pushed by the server, in which case
+	// updates need not be polled for so often
+	bool is_subscribed();
+
+	struct MemoryStats {
+		size_t airports, sids, bytes, limit;
+		size_t pending, missing, error;
+		std::vector<std::pair<std::string, size_t>> largest;
+	};
+
+	// estimated memory use of the cached airport data, and its largest airports
+	MemoryStats memory_stats(size_t largest = 5);
+
+	// least recently used fetched airports are evicted (to be fetched again if
+	// used) to keep the airport data within the limit, if non-zero. airports
+	// loaded from files are never evicted.
+	void set_memory_limit(size_t bytes);
+
 	api::DateTime datetime() override;
 
 	// this creates a TOCTOU issue, but invalidate is called from the same thread
 	// as airport(...)/sid(...) so it's not an issue in practice. if necessary to
 	// change this, we'll create an "Airport" type which references its SID map
 	// and inherits lock_guard (?)
-	Source::CacheStatus airport(const char *icao) override;
+	Source::CacheStatus airport(const char *icao, Source::Priority priority = Source::Priority::Visible) override;
 	std::shared_ptr<const api::Sid> sid(const char *icao, const char *point) override;
+	uint64_t generation(const char *icao) override;
 };
-#endif // ifndef VFPC_STANDALONE
 
-class StaticSource : public virtual Source {
+class StaticSource final : public virtual Source {
 private:
 	api::DateTime datetime_value;
-	std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>> sids;
+	std::shared_ptr<const std::map<std::string, std::map<std::string, std::shared_ptr<api::Sid>>>> sids;
 
 public:
 	StaticSource(nlohmann::json &data, api::DateTime datetime);
 
+	// loads a rules file, parsing it straight from a mapping of the file
+	StaticSource(const char *path, api::DateTime datetime);
+
+	// shares the rules of another source, at another time
+	StaticSource(const StaticSource &rules, api::DateTime datetime);
+
 	api::DateTime datetime() override;
 
-	Source::CacheStatus airport(const char *icao) override;
+	// moves the source to another time, between checks
+	void set_datetime(api::DateTime datetime);
+
+	Source::CacheStatus airport(const char *icao, Source::Priority _priority = Source::Priority::Visible) override;
 	std::shared_ptr<const api::Sid> sid(const char *icao, const char *point) override;
 };
@@ -2,25 +2,287 @@
 #error Cannot compile test program in default plugin mode!
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
+#include <curl/curl.h>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
 #include <config.h>
 #include "check.hpp"
+#include "daemon.hpp"
 #include "flightplan.hpp"
+#include "mirror.hpp"
+#include "pool.hpp"
 #include "source.hpp"
 
+// plans are parsed, and checked, in chunks of up to this many. checked chunks
+// also share a date and time.
+const size_t BATCH_CHUNK = 256;
+
+// requests every airport through a PluginSource, and reports fetch latency
+static int fetch_airports(const char *url, int count, const char *icaos[]) {
+	using Clock = std::chrono::steady_clock;
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	int failed = 0;
+
+	{
+		PluginSource source;
+		source.set(url);
+		source.update();
+
+		auto start = Clock::now();
+
+		std::map<std::string, Clock::time_point> outstanding;
+		std::vector<double> latencies;
+
+		for (int i = 0; i < count; i++) {
+			if (source.airport(icaos[i]) == Source::CacheStatus::Pending)
+				outstanding.emplace(icaos[i], Clock::now());
+			else
+				latencies.push_back(0.0);
+		}
+
+		while (!outstanding.empty()) {
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+			for (auto it = outstanding.begin(); it != outstanding.end();) {
+				auto status = source.airport(it->first.c_str());
+				if (status == Source::CacheStatus::Pending) {
+					it++;
+					continue;
+				}
+
+				if (status == Source::CacheStatus::Error) failed++;
+
+				std::chrono::duration<double, std::milli> latency = Clock::now() - it->second;
+				latencies.push_back(latency.count());
+
+				it = outstanding.erase(it);
+			}
+		}
+
+		std::chrono::duration<double> total = Clock::now() - start;
+		std::sort(latencies.begin(), latencies.end());
+
+		auto percentile = [&latencies](double p) {
+			return latencies[std::min(latencies.size() - 1, (size_t) (p * latencies.size()))];
+		};
+
+		std::cerr
+			<< count << " airports (" << failed << " failed) in " << total.count() << " s, "
+			<< count / total.count() << " airports/s\n"
+			<< "latency (ms): p50 " << percentile(0.5) << ", p95 " << percentile(0.95)
+			<< ", p99 " << percentile(0.99) << ", max " << latencies.back() << "\n";
+	}
+
+	curl_global_cleanup();
+
+	return failed ? 101 : 0;
+}
+
+// checks every flight plan in the input on a pool of threads, writing a JSON
+// line for each in input order, and reports the throughput
+static int check_batch(const char *rules_path, std::istream &input, bool logs) {
+	using Clock = std::chrono::steady_clock;
+
+	// messages run from "(FPL-" to the next ")", and may span lines
+	std::string text, line;
+	while (std::getline(input, line)) text.append(line);
+
+	std::vector<std::string> messages;
+	for (size_t begin = text.find("(FPL-"), end; begin != std::string::npos; begin = text.find("(FPL-", end)) {
+		end = std::min(text.find(')', begin), text.size() - 1) + 1;
+		messages.push_back(text.substr(begin, end - begin));
+	}
+
+	auto start = Clock::now();
+	StaticSource rules(rules_path, {});
+	std::chrono::duration<double> load_time = Clock::now() - start;
+
+	size_t count = messages.size();
+	std::vector<std::unique_ptr<IcaoFlightPlan>> fps(count);
+	std::vector<std::string> errors(count), check_logs(count);
+	std::vector<Result> results(count);
+
+	WorkPool pool;
+	start = Clock::now();
+
+	for (size_t first = 0; first < count; first += BATCH_CHUNK) {
+		pool.submit([&, first]() {
+			for (size_t i = first; i < std::min(first + BATCH_CHUNK, count); i++) {
+				try {
+					fps[i] = std::make_unique<IcaoFlightPlan>(messages[i].c_str());
+				} catch (const char *error) {
+					errors[i] = error;
+				} catch (...) {
+					errors[i] = "bad format";
+				}
+			}
+		});
+	}
+
+	pool.wait();
+
+	// the time of each check comes from its plan's date of flight and EOBT
+	auto key = [&fps](size_t i) {
+		auto datetime = fps[i]->dof_eobt();
+		return std::make_tuple(datetime.date.value_or(UINT8_MAX), datetime.time->hour, datetime.time->minute);
+	};
+
+	std::vector<size_t> order;
+	for (size_t i = 0; i < count; i++)
+		if (fps[i]) order.push_back(i);
+
+	std::stable_sort(order.begin(), order.end(), [&key](size_t a, size_t b) { return key(a) < key(b); });
+
+	for (size_t first = 0, last; first < order.size(); first = last) {
+		for (last = first + 1; last < order.size() && last - first < BATCH_CHUNK; last++)
+			if (key(order[last]) != key(order[first])) break;
+
+		pool.submit([&, first, last]() {
+			StaticSource source(rules, fps[order[first]]->dof_eobt());
+			StaticChecker checker(source);
+
+			std::vector<IcaoFlightPlan *> chunk;
+			for (size_t i = first; i < last; i++) chunk.push_back(fps[order[i]].get());
+
+			std::vector<std::string> chunk_logs;
+			auto chunk_results = checker.check_batch(chunk, logs ? &chunk_logs : nullptr);
+
+			for (size_t i = first; i < last; i++) {
+				results[order[i]] = chunk_results[i - first];
+				if (logs) check_logs[order[i]] = std::move(chunk_logs[i - first]);
+			}
+		});
+	}
+
+	pool.wait();
+
+	std::chrono::duration<double> check_time = Clock::now() - start;
+
+	std::string output;
+	for (size_t i = 0; i < count; i++) {
+		nlohmann::json line = { { "index", i } };
+
+		if (fps[i]) {
+			line["callsign"] = fps[i]->callsign();
+			line["result"] = result_name(results[i]);
+			line["outcome"] = result_outcome(results[i]);
+			if (logs) line["log"] = check_logs[i];
+		} else {
+			line["error"] = errors[i];
+		}
+
+		output.append(line.dump());
+		output.push_back('\n');
+	}
+
+	fwrite(output.data(), 1, output.size(), stdout);
+
+	std::cerr
+		<< "rules loaded in " << load_time.count() << " s\n"
+		<< count << " plans (" << count - order.size() << " unreadable) checked in "
+		<< check_time.count() << " s on " << pool.size() << " threads, "
+		<< count / check_time.count() << " plans/s\n";
+
+	return 0;
+}
+
 int main(int argc, const char *argv[]) {
 	const char *argv0 = argc ? argv[0] : "vfpc";
 
+	if ((argc == 3 || argc == 4) && !strcmp(argv[1], "--mirror")) {
+		try {
+			curl_global_init(CURL_GLOBAL_DEFAULT);
+
+			Mirror mirror(argv[2]);
+			mirror.run(argc == 4 ? std::stoi(argv[3]) : 8080);
+		} catch (const std::string &ex) {
+			std::cerr << "Error: " << ex << "\n";
+
+			return 101;
+		} catch (...) {
+			std::cerr << "Exception thrown\n";
+
+			return 101;
+		}
+	}
+
+	if (argc == 4 && !strcmp(argv[1], "--daemon")) {
+		try {
+			Daemon daemon(argv[2]);
+			daemon.run(argv[3]);
+		} catch (const std::string &ex) {
+			std::cerr << "Error: " << ex << "\n";
+
+			return 101;
+		} catch (...) {
+			std::cerr << "Exception thrown\n";
+
+			return 101;
+		}
+	}
+
+	if (argc > 3 && !strcmp(argv[1], "--fetch")) {
+		try {
+			return fetch_airports(argv[2], argc - 3, argv + 3);
+		} catch (...) {
+			std::cerr << "Exception thrown\n";
+
+			return 101;
+		}
+	}
+
+	if (argc > 2 && !strcmp(argv[1], "--batch")) {
+		bool logs = !strcmp(argv[2], "--logs");
+		int rest = logs ? 3 : 2;
+
+		if (argc == rest + 1 || argc == rest + 2) {
+			try {
+				if (argc == rest + 1) return check_batch(argv[rest], std::cin, logs);
+
+				std::ifstream input(argv[rest + 1]);
+				if (!input) throw std::string("could not open flight plans");
+
+				return check_batch(argv[rest], input, logs);
+			} catch (const std::string &ex) {
+				std::cerr << "Error: " << ex << "\n";
+
+				return 101;
+			} catch (...) {
+				std::cerr << "Exception thrown\n";
+
+				return 101;
+			}
+		}
+	}
+
 	if (argc != 2) {
 		std::cerr
 			<< "Usage: " << argv0 << " <FILE>\n"
-			<< "Validate ICAO flight plan on stdin against rules in FILE.\n\n"
+			<< "       " << argv0 << " --batch [--logs] <FILE> [PLANS]\n"
+			<< "       " << argv0 << " --daemon <FILE> <SOCKET>\n"
+			<< "       " << argv0 << " --fetch <URL> <ICAO>...\n"
+			<< "       " << argv0 << " --mirror <URL> [PORT]\n"
+			<< "Validate ICAO flight plan on stdin against rules in FILE, validate\n"
+			<< "every flight plan in PLANS (or stdin) writing a JSON line for each, serve\n"
+			<< "validation of JSON line requests on the Unix domain socket SOCKET, fetch\n"
+			<< "airports from the data server at URL and report the latency, or serve\n"
+			<< "a caching mirror of the data server at URL on PORT (default 8080).\n\n"
 
 			<< "Exit status:\n"
 			<< "  0        flight plan validated successfully\n"
@@ -40,11 +302,8 @@ int main(int argc, const char *argv[]) {
 
 		IcaoFlightPlan fp(fp_src.c_str());
 
-		std::ifstream file(argv[1]);
-		nlohmann::json data = nlohmann::json::parse(file);
-
-		StaticSource source(data, fp.dof_eobt());
-		Checker checker(source);
+		StaticSource source(argv[1], fp.dof_eobt());
+		StaticChecker checker(source);
 
 		std::string log;
 		Result result = checker.check(fp, &log);
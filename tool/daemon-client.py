@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+
+# A client for the standalone program's daemon mode ("vFPC --daemon"), sending
+# every flight plan message in a file to the socket and printing the responses
+# as JSON lines. Round-trip latency is reported, and with --check, each plan is
+# also sent split over lines as it is filed, failing if any answer differs.
+
+import argparse
+import json
+import socket
+import sys
+import threading
+import time
+
+
+def messages(text):
+	# messages run from "(FPL-" to the next ")", and may span lines
+	start = text.find("(FPL-")
+
+	while start >= 0:
+		end = text.find(")", start)
+		end = len(text) if end < 0 else end + 1
+
+		yield text[start:end]
+		start = text.find("(FPL-", end)
+
+
+def split(plan):
+	# one field per line, as a message is usually filed
+	return "-\r\n".join(plan.replace("\r", "").replace("\n", "").split("-"))
+
+
+class Connection:
+	def __init__(self, path):
+		self.socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+		self.socket.connect(path)
+		self.reader = self.socket.makefile("rb")
+
+	def send(self, requests):
+		data = b"".join((json.dumps(request) + "\n").encode() for request in requests)
+		self.socket.sendall(data)
+
+	def receive(self):
+		return json.loads(self.reader.readline())
+
+
+def percentile(samples, p):
+	return samples[min(len(samples) - 1, int(len(samples) * p))] * 1e6
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Client for the vFPC validation daemon.")
+	parser.add_argument("socket", help="path of the daemon's socket")
+	parser.add_argument("plans", nargs="?", help="file of flight plan messages (default stdin)")
+	parser.add_argument("--logs", action="store_true", help="request each check's log")
+	parser.add_argument("--pipeline", action="store_true",
+		help="send every request before reading any response, and report throughput")
+	parser.add_argument("--check", action="store_true",
+		help="also send each plan split over lines, failing if its answer differs")
+	args = parser.parse_args()
+
+	if args.plans:
+		with open(args.plans) as fd:
+			plans = list(messages(fd.read()))
+	else:
+		plans = list(messages(sys.stdin.read()))
+
+	requests = [{ "id": i, "plan": plan, "logs": args.logs } for i, plan in enumerate(plans)]
+	if args.check:
+		requests += [{ "id": len(plans) + i, "plan": split(plan), "logs": args.logs } for i, plan in enumerate(plans)]
+
+	connection = Connection(args.socket)
+	responses = []
+
+	if args.pipeline:
+		start = time.perf_counter()
+
+		# sent from another thread, so that responses are read as they come
+		sender = threading.Thread(target=connection.send, args=(requests,))
+		sender.start()
+		responses = [connection.receive() for _ in requests]
+		sender.join()
+
+		elapsed = time.perf_counter() - start
+		print("%d requests in %.3f s, %.0f/s" % (len(requests), elapsed, len(requests) / elapsed), file=sys.stderr)
+	else:
+		latencies = []
+
+		for request in requests:
+			start = time.perf_counter()
+			connection.send([request])
+			responses.append(connection.receive())
+			latencies.append(time.perf_counter() - start)
+
+		latencies.sort()
+		print("%d requests, round trip p50 %.0f us, p99 %.0f us" % (
+			len(requests), percentile(latencies, 0.5), percentile(latencies, 0.99),
+		), file=sys.stderr)
+
+	for request, response in zip(requests, responses):
+		if response.get("id") != request["id"]:
+			print("response out of order: expected id %d" % request["id"], file=sys.stderr)
+			return 1
+
+	for response in responses[:len(plans)]:
+		print(json.dumps(response))
+
+	if args.check:
+		failed = 0
+
+		for i, (whole, split_response) in enumerate(zip(responses, responses[len(plans):])):
+			split_response = dict(split_response, id=whole["id"])
+			if split_response != whole:
+				print("plan %d differs when split over lines: %s" % (i, json.dumps(split_response)), file=sys.stderr)
+				failed += 1
+
+		if failed:
+			return 1
+
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
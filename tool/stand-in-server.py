@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+
+# A local stand-in for the vFPC data server, serving airport data from a rules
+# file (in the format accepted by ".vfpc source <FILE>"). Synthetic revisions
+# can be generated to exercise revision-driven sync, and latency, errors and
+# limited bandwidth can be injected to measure fetch behaviour reproducibly.
+
+import argparse
+import datetime
+import gzip
+import json
+import random
+import threading
+import time
+
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+HISTORY = 64
+
+
+class State:
+	def __init__(self, airports):
+		self.lock = threading.Lock()
+		self.changed = threading.Condition(self.lock)
+		self.airports = { airport["icao"]: airport for airport in airports }
+		self.revision = 1
+		self.history = [] # (revision, icao)
+
+	def bump(self, icao=None):
+		with self.lock:
+			if icao is None:
+				icao = random.choice(list(self.airports))
+
+			self.revision += 1
+			self.history = self.history[-HISTORY:] + [(self.revision, icao)]
+			self.changed.notify_all()
+
+			return self.revision, icao
+
+	def changes(self, since):
+		with self.lock:
+			reset = since < self.revision - len(self.history)
+			changed = sorted({ icao for rev, icao in self.history if rev > since })
+
+			return {
+				"revision": self.revision,
+				"reset": reset,
+				"changed": [] if reset else changed,
+				"removed": [],
+			}
+
+
+class Handler(BaseHTTPRequestHandler):
+	protocol_version = "HTTP/1.1"
+
+	def log_message(self, format, *args):
+		if not self.server.quiet:
+			super().log_message(format, *args)
+
+	def send_json(self, code, body):
+		faults = self.server.faults
+
+		if faults.latency or faults.jitter:
+			time.sleep(max(0, faults.latency + random.uniform(-faults.jitter, faults.jitter)) / 1000)
+
+		if random.random() < faults.error_rate:
+			code, body = 503, { "error": "injected failure" }
+
+		data = json.dumps(body).encode()
+		compress = "gzip" in self.headers.get("Accept-Encoding", "")
+
+		if compress:
+			data = gzip.compress(data)
+
+		self.send_response(code)
+		self.send_header("Content-Type", "application/json")
+		if compress:
+			self.send_header("Content-Encoding", "gzip")
+		self.send_header("Content-Length", str(len(data)))
+		self.end_headers()
+
+		if not faults.bandwidth:
+			self.wfile.write(data)
+			return
+
+		# send in small chunks, paced to the bandwidth limit
+		chunk = max(1, faults.bandwidth // 20)
+		for i in range(0, len(data), chunk):
+			self.wfile.write(data[i:i + chunk])
+			self.wfile.flush()
+			time.sleep(chunk / faults.bandwidth)
+
+	def send_events(self):
+		# server-sent events: the current revision on connection, then each new
+		# revision, with comments to keep the connection alive
+		state = self.server.state
+
+		self.send_response(200)
+		self.send_header("Content-Type", "text/event-stream")
+		self.send_header("Cache-Control", "no-cache")
+		self.send_header("Connection", "close")
+		self.end_headers()
+
+		sent = None
+
+		try:
+			while True:
+				with state.lock:
+					if sent == state.revision:
+						state.changed.wait(15)
+
+					revision = state.revision
+
+				if revision == sent:
+					self.wfile.write(b": keep-alive\n\n")
+				else:
+					self.wfile.write(b"event: revision\ndata: %s\n\n" % json.dumps({ "revision": revision }).encode())
+					sent = revision
+
+				self.wfile.flush()
+		except (BrokenPipeError, ConnectionResetError):
+			pass
+
+		self.close_connection = True
+
+	def do_GET(self):
+		url = urlparse(self.path)
+		query = parse_qs(url.query)
+		state = self.server.state
+
+		if url.path == "/version":
+			now = datetime.datetime.now(datetime.timezone.utc)
+
+			self.send_json(200, {
+				"api_version": "stand-in",
+				"time": now.strftime("%H:%M:%S"),
+				"day": (now.weekday() + 1) % 7,
+				"revision": state.revision,
+			})
+		elif url.path == "/airport":
+			icao = query.get("icao", [""])[0].upper()
+
+			if not icao.startswith("EG"):
+				self.send_json(400, { "error": "not a UK airport" })
+			elif icao not in state.airports:
+				self.send_json(404, { "error": "unknown airport" })
+			else:
+				self.send_json(200, [state.airports[icao]])
+		elif url.path == "/directory":
+			with state.lock:
+				self.send_json(200, sorted(state.airports))
+		elif url.path == "/airports":
+			with state.lock:
+				self.send_json(200, list(state.airports.values()))
+		elif url.path == "/events" and not self.server.no_events:
+			self.send_events()
+		elif url.path == "/changes":
+			try:
+				since = int(query.get("since", [""])[0])
+			except ValueError:
+				self.send_json(400, { "error": "bad revision" })
+				return
+
+			self.send_json(200, state.changes(since))
+		else:
+			self.send_json(404, { "error": "not found" })
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Local stand-in vFPC data server.")
+	parser.add_argument("rules", help="rules file to serve")
+	parser.add_argument("--port", type=int, default=8080)
+	parser.add_argument("--bump", type=float, metavar="SECONDS",
+		help="create a synthetic revision touching a random airport at this interval")
+	parser.add_argument("--latency", type=float, default=0, metavar="MS",
+		help="delay every response by this long")
+	parser.add_argument("--jitter", type=float, default=0, metavar="MS",
+		help="vary the delay uniformly by up to this much either way")
+	parser.add_argument("--error-rate", type=float, default=0, metavar="P",
+		help="fail this proportion of requests with 503")
+	parser.add_argument("--bandwidth", type=int, default=0, metavar="BYTES",
+		help="limit each response to this many bytes per second")
+	parser.add_argument("--seed", type=int, help="seed the injected faults, for reproducibility")
+	parser.add_argument("--no-events", action="store_true",
+		help="don't serve change notifications, so that clients must poll")
+	parser.add_argument("--quiet", action="store_true", help="don't log requests")
+	args = parser.parse_args()
+
+	if args.seed is not None:
+		random.seed(args.seed)
+
+	with open(args.rules) as fd:
+		state = State(json.load(fd))
+
+	server = ThreadingHTTPServer(("127.0.0.1", args.port), Handler)
+	server.state = state
+	server.quiet = args.quiet
+	server.faults = args
+	server.no_events = args.no_events
+
+	if args.bump:
+		def bump():
+			while True:
+				time.sleep(args.bump)
+				print("revision %d: changed %s" % state.bump(), flush=True)
+
+		threading.Thread(target=bump, daemon=True).start()
+
+	print("serving on http://127.0.0.1:%d/" % args.port, flush=True)
+	server.serve_forever()
+
+
+if __name__ == "__main__":
+	main()